@@ -0,0 +1,160 @@
+#pragma once
+
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+// Timed cleaning cycle (rinse, descale, dry) driven by a background timer thread.
+// The timer also ticks while idle so the owner can decide to start a cycle on its own.
+// Callbacks run on the timer thread without any CleaningCycle lock held, so they may call start().
+class CleaningCycle
+{
+public:
+  enum Phase
+  {
+    IDLE,
+    RINSE,
+    DESCALE,
+    DRY
+  };
+
+  // How the server uses a cycle, shared with tools/FleetSimulator:
+  // orders arriving during a cycle wait for it (up to MAX_QUEUED_ORDERS, the rest get 503), and a machine
+  // below AUTO_CLEAN_LEVEL starts a cycle on its own once nobody ordered for AUTO_CLEAN_IDLE
+  static const size_t MAX_QUEUED_ORDERS = 100;
+  static const int AUTO_CLEAN_LEVEL = 30; // "Dirty - will need cleaning soon"
+  static constexpr std::chrono::seconds AUTO_CLEAN_IDLE{60};
+
+  struct Durations
+  {
+    std::chrono::milliseconds rinse{20000};
+    std::chrono::milliseconds descale{30000};
+    std::chrono::milliseconds dry{10000};
+  };
+
+  CleaningCycle(Durations durations, std::chrono::milliseconds idleTick,
+                std::function<void()> onFinished, std::function<void()> onIdleTick)
+      : durations(durations), idleTick(idleTick), onFinished(std::move(onFinished)), onIdleTick(std::move(onIdleTick))
+  {
+    timer = std::thread(&CleaningCycle::run, this);
+  }
+
+  ~CleaningCycle()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wakeup.notify_one();
+    timer.join();
+  }
+
+  // Returns false if a cycle is already running
+  bool start()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (phase != IDLE)
+        return false;
+      enter(RINSE);
+    }
+    wakeup.notify_one();
+    return true;
+  }
+
+  Phase getPhase()
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    return phase;
+  }
+
+  static const char *getPhaseName(Phase value)
+  {
+    static const char *names[] = {"IDLE", "RINSE", "DESCALE", "DRY"};
+    return names[value];
+  }
+
+  // Time left until the whole cycle is done, zero when idle
+  std::chrono::milliseconds getRemaining()
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (phase == IDLE)
+      return std::chrono::milliseconds(0);
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(phaseEnd - Clock::now());
+    if (phase == RINSE)
+      remaining += durations.descale + durations.dry;
+    else if (phase == DESCALE)
+      remaining += durations.dry;
+    return std::max(remaining, std::chrono::milliseconds(0));
+  }
+
+  std::chrono::milliseconds getTotalDuration() const
+  {
+    return durations.rinse + durations.descale + durations.dry;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void enter(Phase next)
+  {
+    phase = next;
+    if (next == RINSE)
+      phaseEnd = Clock::now() + durations.rinse;
+    else if (next == DESCALE)
+      phaseEnd = Clock::now() + durations.descale;
+    else if (next == DRY)
+      phaseEnd = Clock::now() + durations.dry;
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping)
+    {
+      Clock::time_point deadline = phase == IDLE ? Clock::now() + idleTick : phaseEnd;
+      wakeup.wait_until(guard, deadline);
+      if (stopping)
+        return;
+
+      bool finished = false, idle = false;
+      if (phase == IDLE)
+        idle = Clock::now() >= deadline;
+      else if (Clock::now() >= phaseEnd)
+      {
+        if (phase == DRY)
+        {
+          phase = IDLE;
+          finished = true;
+        }
+        else
+          enter(phase == RINSE ? DESCALE : DRY);
+      }
+
+      if (finished || idle)
+      {
+        guard.unlock();
+        if (finished)
+          onFinished();
+        else
+          onIdleTick();
+        guard.lock();
+      }
+    }
+  }
+
+  Durations durations;
+  std::chrono::milliseconds idleTick;
+  std::function<void()> onFinished;
+  std::function<void()> onIdleTick;
+
+  std::mutex lock;
+  std::condition_variable wakeup;
+  Phase phase = IDLE;
+  Clock::time_point phaseEnd;
+  bool stopping = false;
+  std::thread timer;
+};
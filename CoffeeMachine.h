@@ -0,0 +1,317 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <nlohmann/json.hpp>
+
+// Defining the class of the CoffeeMachine. It should model the entire configuration of the CoffeeMachine
+class CoffeeMachine
+{
+public:
+  explicit CoffeeMachine() {}
+
+  // COFFEE TYPE
+  // Setter
+  void setCoffeeType(std::string value)
+  {
+    // Find index of coffee type string
+    auto it = std::find(coffeeTypeString.begin(), coffeeTypeString.end(), value);
+
+    if (it != coffeeTypeString.end())
+    {                                               // If found
+      int index = it - coffeeTypeString.begin();    // Get index
+      coffeeType = static_cast<COFFEE_TYPE>(index); // Int to enum
+    }
+    // We could return 0 or 1 depending if enum was found and set
+  }
+
+  // Getter
+  std::string getCoffeeType()
+  {
+    return coffeeTypeString[coffeeType];
+  }
+
+  // CUP SIZE
+  // Setter
+  void setCupSize(std::string value)
+  {
+    // Find index of coffee type string
+    auto it = std::find(cupSizeString.begin(), cupSizeString.end(), value);
+
+    if (it != cupSizeString.end())
+    {                                         // If found
+      int index = it - cupSizeString.begin(); // Get index
+      cupSize = static_cast<CUP_SIZE>(index); // Int to enum
+    }
+    // We could return 0 or 1 depending if enum was found and set
+  }
+
+  // Getter
+  std::string getCupSize()
+  {
+    return cupSizeString[cupSize];
+  }
+
+  // FOAM SIZE
+  // Setter
+  void setFoamSize(std::string value)
+  {
+    // Find index of coffee type string
+    auto it = std::find(foamSizeString.begin(), foamSizeString.end(), value);
+
+    if (it != foamSizeString.end())
+    {                                           // If found
+      int index = it - foamSizeString.begin();  // Get index
+      foamSize = static_cast<FOAM_SIZE>(index); // Int to enum
+    }
+    // We could return 0 or 1 depending if enum was found and set
+  }
+
+  // Getter
+  std::string getFoamSize()
+  {
+    return foamSizeString[foamSize];
+  }
+
+  // COFFEE STRENGTH
+  // Setter
+  void setCoffeeStrength(int value)
+  {
+    coffeeStrength = value;
+  }
+
+  // Getter
+  int getCoffeeStrength()
+  {
+    return coffeeStrength;
+  }
+
+  // MILK
+  // Setter
+  void setMilkLevel(int value)
+  {
+    notifyCrossing("MILK", milkLevel, value, REFILL_THRESHOLD);
+    milkLevel = value;
+  }
+
+  // Getter
+  int getMilkLevel()
+  {
+    return milkLevel;
+  }
+
+  // WATER
+  // Setter
+  void setWaterLevel(int value)
+  {
+    notifyCrossing("WATER", waterLevel, value, REFILL_THRESHOLD);
+    waterLevel = value;
+  }
+
+  // Getter
+  int getWaterLevel()
+  {
+    return waterLevel;
+  }
+
+  // BEANS
+  // Setter
+  void setBeansLevel(int value)
+  {
+    notifyCrossing("BEANS", beansLevel, value, REFILL_THRESHOLD);
+    beansLevel = value;
+  }
+
+  // Getter
+  int getBeansLevel()
+  {
+    return beansLevel;
+  }
+
+  // Clean
+  // Setter
+  void setCleanLevel(int value)
+  {
+    notifyCrossing("CLEAN", cleanLevel, value, SUPER_DIRTY_THRESHOLD);
+    cleanLevel = value;
+  }
+
+  // Getter
+  int getCleanLevel()
+  {
+    return cleanLevel;
+  }
+
+  // LedStrip
+  // Setter
+  void setLedStripState(bool value)
+  {
+    ledStrip = value;
+  }
+
+  // Getter
+  bool getLedStripState()
+  {
+    return ledStrip;
+  }
+
+  // LedStrip color
+  // Setter
+  void setLedStripColor(std::string value)
+  {
+    ledStripcolor = value;
+  }
+
+  // Getter
+  std::string getLedStripColor()
+  {
+    return ledStripcolor;
+  }
+  
+  std::vector<std::string> getCoffeeTypeValues()
+  {
+    return coffeeTypeString;
+  }
+
+  // Position of a coffee type in getCoffeeTypeValues, without copying the list. Types are only ever appended,
+  // so the position of a type never changes.
+  size_t getCoffeeTypeIndex(const std::string &value)
+  {
+    return std::find(coffeeTypeString.begin(), coffeeTypeString.end(), value) - coffeeTypeString.begin();
+  }
+
+  std::vector<std::string> getCupSizeValues()
+  {
+    return cupSizeString;
+  }
+
+  std::vector<std::string> getFoamSizeValues()
+  {
+    return foamSizeString;
+  }
+
+  std::vector<std::string> getResourceTypeValues()
+  {
+    return resourceTypeString;
+  }
+  nlohmann::json getCoffeeRecipes()
+  {
+    return coffeeRecipes;
+  }
+  // Recipe of a coffee type without copying the table, nullptr when there is none
+  const nlohmann::json *findRecipe(const std::string &type)
+  {
+    auto it = coffeeRecipes.find(type);
+    return it != coffeeRecipes.end() ? &*it : nullptr;
+  }
+  void setCustomRecipe(std::vector<int> ingredients)
+  {
+    if (std::find(coffeeTypeString.begin(), coffeeTypeString.end(), "CUSTOM") == coffeeTypeString.end())
+      coffeeTypeString.push_back("CUSTOM");
+    coffeeRecipes["CUSTOM"] = ingredients;
+  }
+
+  // Positions of the ingredients in a coffeeRecipes entry: {coffeeStrength, milk, water, beans}
+  static const int RECIPE_MILK = 1;
+  static const int RECIPE_WATER = 2;
+  static const int RECIPE_BEANS = 3;
+
+  // Every cup makes the machine this much dirtier
+  static const int CLEAN_LEVEL_PER_CUP = 5;
+
+  // A cleaning cycle is only started on request below this clean level
+  static const int CLEAN_THRESHOLD = 70;
+
+  // Below this milk, water or beans level the machine needs a refill
+  static const int REFILL_THRESHOLD = 30;
+
+  // Below this clean level the machine is "Super dirty"
+  static const int SUPER_DIRTY_THRESHOLD = 10;
+
+  // Reported by the setters when a level crosses its threshold, in either direction
+  struct LevelEvent
+  {
+    std::string resource; // MILK, WATER, BEANS or CLEAN
+    int level;
+    bool low; // true when the level went below the threshold, false when it recovered
+  };
+
+  // The listener runs on the thread calling the setter, so it must not block
+  void setLevelListener(std::function<void(const LevelEvent &)> listener)
+  {
+    levelListener = std::move(listener);
+  }
+
+private:
+  void notifyCrossing(const char *resource, int oldLevel, int newLevel, int threshold)
+  {
+    if (levelListener && (oldLevel < threshold) != (newLevel < threshold))
+      levelListener(LevelEvent{resource, newLevel, newLevel < threshold});
+  }
+
+  std::function<void(const LevelEvent &)> levelListener;
+
+  // Defining and instantiating settings.
+  enum COFFEE_TYPE
+  {
+    CAPPUCCINO,
+    ESPRESSO,
+    LATTE_MACHIATTO,
+    CAFFE_LATTE,
+    DOPPIO,
+    AMERICANO
+  } coffeeType = COFFEE_TYPE::CAFFE_LATTE;
+
+  // Can't find another easy way to convert string to enum and back so I'm gonna use this
+  std::vector<std::string> coffeeTypeString =
+      {"CAPPUCCINO", "ESPRESSO", "LATTE_MACHIATTO", "CAFFE_LATTE", "DOPPIO", "AMERICANO"};
+
+  std::vector<std::string> resourceTypeString =
+      {"MILK", "WATER", "BEANS"};
+
+  //Enum names are in global scope so they must be unique => cant have CUP_SIZE::S and FOAM_SIZE::S
+  enum CUP_SIZE
+  {
+    CUP_S,
+    CUP_M,
+    CUP_L,
+    CUP_XL
+  } cupSize = CUP_SIZE::CUP_S;
+
+  std::vector<std::string> cupSizeString =
+      {"CUP_S", "CUP_M", "CUP_L", "CUP_XL"};
+
+  enum FOAM_SIZE
+  {
+    FOAM_S,
+    FOAM_M,
+    FOAM_L
+  } foamSize = FOAM_SIZE::FOAM_S;
+
+  std::vector<std::string> foamSizeString =
+      {"FOAM_S", "FOAM_M", "FOAM_L"};
+
+  int coffeeStrength = 45; // 45mg - 100mg
+
+  int milkLevel = 100; // 0 - 100
+
+  int waterLevel = 100; // 0 - 100
+
+  int beansLevel = 100; // 0 - 100
+
+  int cleanLevel = 100; // 0 - 100
+
+  bool ledStrip = false;
+
+  std::string ledStripcolor;
+
+  nlohmann::json coffeeRecipes = {
+      {"CAPPUCCINO", {50, 5, 10, 5}},
+      {"ESPRESSO", {100, 0, 10, 5}},
+      {"LATTE_MACHIATTO", {50, 10, 10, 5}},
+      {"CAFFE_LATTE", {50, 8, 10, 5}},
+      {"DOPPIO", {100, 0, 7, 10}},
+      {"AMERICANO", {60, 8, 7, 5}}};
+};
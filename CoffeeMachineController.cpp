@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sstream>
+#include <deque>
 #include <string.h>
 #include <regex>
 #include <algorithm>
@@ -17,6 +18,14 @@
 #include <signal.h>
 #include <nlohmann/json.hpp>
 
+#include "CleaningCycle.h"
+#include "CoffeeMachine.h"
+#include "OrderValidator.h"
+#include "SessionTokens.h"
+#include "ShardedCounters.h"
+#include "TrafficCapture.h"
+#include "WebhookDispatcher.h"
+
 using namespace std;
 using namespace Pistache;
 using namespace nlohmann;
@@ -36,7 +45,26 @@ public:
     auto opts = Http::Endpoint::options()
                     .threads(static_cast<int>(thr));
     httpEndpoint->init(opts);
-    // Server routes are loaded up
+    // One counter slot per worker thread, plus one for the cleaning timer thread (finishCleaning counts too)
+    orderCounters = std::make_unique<ShardedCounters<ORDER_COUNTERS>>(thr + 1);
+    // Cleaning runs as a timed cycle; the idle tick drives the automatic cleaning
+    cleaningCycle = std::make_unique<CleaningCycle>(
+        cleaningDurations, std::chrono::seconds(1),
+        [this]()
+        { finishCleaning(); },
+        [this]()
+        { autoClean(); });
+    // Serve HTTPS when a certificate was configured. Pistache creates the OpenSSL context itself and does not
+    // expose it, so no session ticket or session cache setting is made here; whatever OpenSSL defaults to applies.
+#ifdef PISTACHE_USE_SSL
+    if (!tlsCertificate.empty())
+    {
+      httpEndpoint->useSSL(tlsCertificate, tlsKey);
+      tlsEnabled = true;
+    }
+#endif
+    // Server routes and request validators are loaded up
+    setupValidators();
     setupRoutes();
   }
 
@@ -47,205 +75,323 @@ public:
     httpEndpoint->serveThreaded();
   }
 
+  // Length of the rinse, descale and dry phases of a cleaning cycle. Call before init.
+  void setCleaningDurations(CleaningCycle::Durations durations)
+  {
+    cleaningDurations = durations;
+  }
+
+  // Certificate and private key (PEM files) used to serve HTTPS. Call before init.
+  // Returns false when Pistache was built without SSL support, so HTTPS can't be served.
+  bool useTls(const string &certificate, const string &key)
+  {
+#ifdef PISTACHE_USE_SSL
+    tlsCertificate = certificate;
+    tlsKey = key;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Records every incoming request into a capture file for tools/TrafficReplay. Call before start.
+  bool captureTraffic(const string &path)
+  {
+    trafficCapture = std::make_unique<TrafficCapture::Writer>(path);
+    if (!trafficCapture->isOpen())
+      trafficCapture.reset();
+    return trafficCapture != nullptr;
+  }
+
+  // Pushes low resource and "Super dirty" events to the given webhooks instead of having monitoring poll
+  // /getResourceLevels and /getCleanLevel. machine identifies this server in the notifications. Call before start.
+  void notifyWebhooks(const vector<string> &urls, const string &machine)
+  {
+    webhooks = std::make_unique<WebhookDispatcher>(urls, machine);
+    if (!webhooks->hasTargets())
+    {
+      webhooks.reset();
+      return;
+    }
+    coffeeMachine.setLevelListener([this](const CoffeeMachine::LevelEvent &levelEvent)
+                                   {
+      json event;
+      event["resource"] = levelEvent.resource;
+      event["level"] = levelEvent.level;
+      if (!levelEvent.low)
+        event["state"] = "OK";
+      else
+        event["state"] = levelEvent.resource == "CLEAN" ? "SUPER_DIRTY" : "NEEDS_REFILL";
+      event["time"] = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+      webhooks->notify(levelEvent.resource, event); });
+  }
+
+  // Tokens signed with the same secret are accepted by every server using it
+  void setSessionSecret(const string &secret)
+  {
+    sessionTokens.setSecret(secret);
+  }
+
   // When signaled server shuts down
   void stop()
   {
+    // Orders still waiting for the cleaning cycle won't be made anymore. They are answered while the
+    // endpoint can still deliver the replies, and no new cycle or queued order is accepted from here on.
+    {
+      Guard guard(coffeeMachineLock);
+      shuttingDown = true;
+      cleaning = false;
+      for (auto &order : queuedOrders)
+      {
+        json res;
+        res["status"] = "Coffee machine is shutting down";
+        order.second.send(Http::Code::Service_Unavailable, res.dump(4));
+      }
+      queuedOrders.clear();
+    }
+    cleaningCycle.reset();
     httpEndpoint->shutdown();
+    if (trafficCapture && trafficCapture->getDropped() > 0)
+      cerr << "Traffic capture dropped " << trafficCapture->getDropped() << " requests" << endl;
+    // Flushes the rest of the capture file
+    trafficCapture.reset();
+    // Makes a last attempt to deliver pending notifications
+    webhooks.reset();
   }
 
 private:
+  // Binds a handler to a route. Requests are recorded first when traffic capture is on.
+  Rest::Route::Handler handle(void (CoffeeMachineController::*handler)(const Rest::Request &, Http::ResponseWriter))
+  {
+    return [this, handler](const Rest::Request &request, Http::ResponseWriter response)
+    {
+      if (trafficCapture)
+      {
+        TrafficCapture::Method method = request.method() == Http::Method::Get    ? TrafficCapture::GET
+                                        : request.method() == Http::Method::Post ? TrafficCapture::POST
+                                                                                 : TrafficCapture::OTHER;
+        trafficCapture->record(method, request.resource(), request.body());
+      }
+      (this->*handler)(request, std::move(response));
+      return Rest::Route::Result::Ok;
+    };
+  }
+
   void setupRoutes()
   {
     using namespace Rest;
-    Routes::Get(router, "/auth", Routes::bind(&CoffeeMachineController::doAuth, this));
+    Routes::Get(router, "/auth", handle(&CoffeeMachineController::doAuth));
 
     // I'm making the make coffee endpoint Post because it reads from request body and it alters the state of the machine. Sounds like post
-    Routes::Post(router, "/coffee", Routes::bind(&CoffeeMachineController::makeCoffee, this));
-    Routes::Post(router, "/customCoffee", Routes::bind(&CoffeeMachineController::setCustomRecipe, this));
+    Routes::Post(router, "/coffee", handle(&CoffeeMachineController::makeCoffee));
+    Routes::Post(router, "/customCoffee", handle(&CoffeeMachineController::setCustomRecipe));
+    Routes::Get(router, "/getOrderStats", handle(&CoffeeMachineController::getOrderStats));
     // Clean coffee machine
-    Routes::Get(router, "/getCleanLevel", Routes::bind(&CoffeeMachineController::cleanLevel, this));
-    Routes::Post(router, "/cleanCoffeeMachine", Routes::bind(&CoffeeMachineController::clean, this));
+    Routes::Get(router, "/getCleanLevel", handle(&CoffeeMachineController::cleanLevel));
+    Routes::Post(router, "/cleanCoffeeMachine", handle(&CoffeeMachineController::clean));
 
     // Led strip controller
-    Routes::Get(router, "/getLedStrip", Routes::bind(&CoffeeMachineController::getLedStrip, this));
-    Routes::Post(router, "/setLedStrip", Routes::bind(&CoffeeMachineController::setLedStrip, this));
+    Routes::Get(router, "/getLedStrip", handle(&CoffeeMachineController::getLedStrip));
+    Routes::Post(router, "/setLedStrip", handle(&CoffeeMachineController::setLedStrip));
 
     // Refill resource levels
-    Routes::Get(router, "/getResourceLevels", Routes::bind(&CoffeeMachineController::getRefillResourceLevels, this));
-    Routes::Post(router, "/refillResourceLevel", Routes::bind(&CoffeeMachineController::refillResourceLevel, this));
+    Routes::Get(router, "/getResourceLevels", handle(&CoffeeMachineController::getRefillResourceLevels));
+    Routes::Post(router, "/refillResourceLevel", handle(&CoffeeMachineController::refillResourceLevel));
   }
 
   void doAuth(const Rest::Request &request, Http::ResponseWriter response)
   {
     // Function that prints cookies
     // printCookies(request);
-    // In the response object, it adds a cookie regarding the communications language.
+    // In the response object, it adds a cookie regarding the communications language
+    // and the signed session token required by the POST endpoints.
+    Http::Cookie session("session", sessionTokens.issue());
+    session.maxAge = static_cast<int>(sessionTokens.getTtl());
+    session.httpOnly = true;
+    // A secure cookie is never sent back over plain HTTP, so it is only marked so when HTTPS is really served
+    session.secure = tlsEnabled;
     response.cookies()
-        .add(Http::Cookie("lang", "en-US"));
+        .add(Http::Cookie("lang", "en-US"))
+        .add(session);
     // Send the response
     response.send(Http::Code::Ok, "Coffee machine is online.");
   }
-  string checkCoffeeReq(json req)
-  { // Validates ingredients of a custom recipe request
-    string status = "";
-
-    if (!req["milkLevel"].is_number_integer() || !req["coffeeStrength"].is_number_integer() 
-    || !req["beansLevel"].is_number_integer() || !req["waterLevel"].is_number_integer())
+  // Checks the session token from the "session" cookie or an "Authorization: Bearer" header;
+  // when it is missing, expired or forged answers 401 and returns false
+  bool authorize(const Rest::Request &request, Http::ResponseWriter &response)
+  {
+    string token;
+    if (request.cookies().has("session"))
     {
-      status = "Arguments for coffee details must be integer numbers!";
-      return status;
+      token = request.cookies().get("session").value;
+    }
+    else
+    {
+      auto authorization = request.headers().tryGet<Http::Header::Authorization>();
+      string bearer = "Bearer ";
+      if (authorization && authorization->value().compare(0, bearer.size(), bearer) == 0)
+        token = authorization->value().substr(bearer.size());
     }
-    int milkLevel = req["milkLevel"];
-    int coffeeStrength = req["coffeeStrength"];
-    int beansLevel = req["beansLevel"];
-    int waterLevel = req["waterLevel"];
 
-    if (milkLevel > 15 || milkLevel < 0)
-      status.append("Invalid milk level! Milk level should be between 0 and 15!\n");
-    if (coffeeStrength > 100 || coffeeStrength < 0)
-      status.append("Invalid coffee level! Coffee level should be between 0 and 100!\n");
-    if (beansLevel > 10 || beansLevel < 0)
-      status.append("Invalid beans level! Beans level should be between 0 and 10!\n");
-    if (waterLevel > 10 || waterLevel < 0)
-      status.append("Invalid water level! Water level should be between 0 and 10!\n");
+    if (!token.empty() && sessionTokens.verify(token))
+      return true;
 
-    if (status == "")
-      status = "OK";
-    return status;
+    json res;
+    res["status"] = "Missing or expired session token! Authenticate on /auth";
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    response.send(Http::Code::Unauthorized, res.dump(4));
+    return false;
   }
-  void setCustomRecipe(const Rest::Request &request, Http::ResponseWriter response)
+
+  // Validation tables, built once in init and only read afterwards, so the worker threads share them without a lock.
+  // The coffee types change when a custom recipe is added; the type rule reads them from the coffeeTypes snapshot.
+  void setupValidators()
   {
+    coffeeTypes = std::make_shared<const vector<string>>(coffeeMachine.getCoffeeTypeValues());
+    coffeeOrderRules = {
+        OrderValidator::oneOfCurrent("type", coffeeTypes, "Invalid coffee type!"),
+        OrderValidator::oneOf("cupSize", coffeeMachine.getCupSizeValues(), "Invalid cup size!"),
+        OrderValidator::oneOf("foamSize", coffeeMachine.getFoamSizeValues(), "Invalid foam size!"),
+        OrderValidator::intRange("coffeeStrength", 45, 100, "Invalid coffee strength!")};
+
+    customRecipeRules = {
+        OrderValidator::intRange("milkLevel", 0, 15, "Invalid milk level! Milk level should be an integer between 0 and 15!"),
+        OrderValidator::intRange("coffeeStrength", 0, 100, "Invalid coffee level! Coffee level should be an integer between 0 and 100!"),
+        OrderValidator::intRange("beansLevel", 0, 10, "Invalid beans level! Beans level should be an integer between 0 and 10!"),
+        OrderValidator::intRange("waterLevel", 0, 10, "Invalid water level! Water level should be an integer between 0 and 10!")};
+
+    refillRules = {
+        OrderValidator::oneOf("resourceType", coffeeMachine.getResourceTypeValues(), "Invalid resource type!")};
+
+    ledStripRules = {
+        OrderValidator::boolean("state", "Invalid LedStrip state! State should be true or false!"),
+        OrderValidator::matches("color", "#[a-fA-F0-9]{6}", "Color validation failed!")};
+  }
+
+  // Parses the request body; on malformed JSON answers 400 and returns false
+  bool parseBody(const Rest::Request &request, Http::ResponseWriter &response, json &req)
+  {
+    if (OrderValidator::parse(request.body(), req))
+      return true;
 
-    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
-    json req = json::parse(request.body());
     json res;
-    try
-    {
-      string status = checkCoffeeReq(req);
-      if (status != "OK")
-      {
-        res["status"] = status;
-        response.send(Http::Code::Bad_Request, res.dump(4));
-        return;
-      }
-      int milkLevel = req["milkLevel"];
-      int coffeeStrength = req["coffeeStrength"];
-      int beansLevel = req["beansLevel"];
-      int waterLevel = req["waterLevel"];
+    res["status"] = "Malformed JSON body!";
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    response.send(Http::Code::Bad_Request, res.dump(4));
+    return false;
+  }
 
-      vector<int> ingredients = {coffeeStrength, milkLevel, beansLevel, waterLevel};
-      coffeeMachine.setCustomRecipe(ingredients);
-      coffeeMachine.setCoffeeType("CUSTOM");
+  // Runs the given rules; on failure answers 400 with every violation and returns false
+  bool validateBody(const json &req, const vector<OrderValidator::Rule> &rules, const string &status, Http::ResponseWriter &response)
+  {
+    uint32_t failed = OrderValidator::validate(req, rules);
+    if (failed == 0)
+      return true;
 
-      res["status"] = "Added custom recipe!";
-      response.send(Http::Code::Ok, res.dump(4));
-      return;
-    }
-    catch (exception e)
-    {
-      res["status"] = "Creating recipe failed!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
-    }
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    response.send(Http::Code::Bad_Request, OrderValidator::errorResponse(rules, failed, status));
+    return false;
   }
-  void makeCoffee(const Rest::Request &request, Http::ResponseWriter response)
+
+  void setCustomRecipe(const Rest::Request &request, Http::ResponseWriter response)
   {
-    // Very helpful -> https://kezunlin.me/post/f3c3eb8/
+    json req;
+    if (!authorize(request, response) || !parseBody(request, response, req) || !validateBody(req, customRecipeRules, "Invalid custom recipe!", response))
+      return;
+    Guard guard(coffeeMachineLock);
 
-    // Need to explicitly use json::parse (not just = request.body()) or else it won't work :/
-    json req = json::parse(request.body());
-    cout << req.dump(4); //4 spaces as tab in json
+    int milkLevel = req["milkLevel"];
+    int coffeeStrength = req["coffeeStrength"];
+    int beansLevel = req["beansLevel"];
+    int waterLevel = req["waterLevel"];
+
+    vector<int> ingredients = {coffeeStrength, milkLevel, beansLevel, waterLevel};
+    coffeeMachine.setCustomRecipe(ingredients);
+    coffeeMachine.setCoffeeType("CUSTOM");
+    // CUSTOM is now an accepted coffee type; requests being validated keep the snapshot they loaded
+    std::atomic_store(&coffeeTypes, std::make_shared<const vector<string>>(coffeeMachine.getCoffeeTypeValues()));
 
     json res;
+    res["status"] = "Added custom recipe!";
     response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    response.send(Http::Code::Ok, res.dump(4));
+  }
+  void makeCoffee(const Rest::Request &request, Http::ResponseWriter response)
+  {
+    // Very helpful -> https://kezunlin.me/post/f3c3eb8/
 
-    //coffeeType validation
-    try
-    {
-      if (!req["type"].is_string())
-      {
-        throw 505;
-      }
-      string type = req["type"];
-      vector<string> coffeeTypeStrings = coffeeMachine.getCoffeeTypeValues();
-      auto it = find(coffeeTypeStrings.begin(), coffeeTypeStrings.end(), type);
-      if (it == coffeeTypeStrings.end())
-      {
-        throw 505;
-      }
-    }
-    catch (int error)
+    // Malformed bodies and invalid fields are answered with 400 without throwing
+    json req;
+    if (!authorize(request, response))
+      return;
+    if (!parseBody(request, response, req) || !validateBody(req, coffeeOrderRules, "Invalid coffee order!", response))
     {
-      res["status"] = "Invalid coffee type!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
+      orderCounters->add(ORDERS_INVALID);
       return;
     }
+    cout << req.dump(4); //4 spaces as tab in json
 
-    //cupSize validation
-    try
-    {
-      if (!req["cupSize"].is_string())
-      {
-        throw 505;
-      }
-      string cupSize = req["cupSize"];
-      vector<string> cupSizeTypeStrings = coffeeMachine.getCupSizeValues();
-      auto it = find(cupSizeTypeStrings.begin(), cupSizeTypeStrings.end(), cupSize);
-
-      if (it == cupSizeTypeStrings.end())
-      {
-        throw 505;
-      }
-    }
-    catch (int error)
+    // Counters are bumped after the lock is released, so orders only serialize on the machine itself
+    unsigned counted;
     {
-      res["status"] = "Invalid cup size!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
-      return;
+      Guard guard(coffeeMachineLock);
+      counted = takeOrder(req, response);
     }
+    countOrder(counted);
+  }
 
-    //foamSize validation
-    try
-    {
-      if (!req["foamSize"].is_string())
-      {
-        throw 505;
-      }
-      string foamSize = req["foamSize"];
-      vector<string> foamSizeTypeStrings = coffeeMachine.getFoamSizeValues();
-      auto it = find(foamSizeTypeStrings.begin(), foamSizeTypeStrings.end(), foamSize);
+  // Counters an order touched, as a bit per OrderCounter, so they can be bumped outside coffeeMachineLock
+  static unsigned counterBit(size_t counter)
+  {
+    return 1u << counter;
+  }
 
-      if (it == foamSizeTypeStrings.end())
-      {
-        throw 505;
-      }
-    }
-    catch (int error)
+  void countOrder(unsigned counted)
+  {
+    for (size_t counter = 0; counted != 0; counter++, counted >>= 1)
+      if (counted & 1)
+        orderCounters->add(counter);
+  }
+
+  // Brews, queues or rejects a validated order. Called with coffeeMachineLock held; returns the counters to bump.
+  unsigned takeOrder(const json &req, Http::ResponseWriter &response)
+  {
+    if (shuttingDown)
     {
-      res["status"] = "Invalid foam size!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
-      return;
+      json res;
+      res["status"] = "Coffee machine is shutting down";
+      response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+      response.send(Http::Code::Service_Unavailable, res.dump(4));
+      return 0;
     }
+    lastOrder = std::chrono::steady_clock::now();
 
-    //coffeeStrength validation
-    try
+    // A machine too dirty to brew starts cleaning itself; while a cleaning cycle runs
+    // orders wait in line and are made as soon as it ends, instead of being rejected
+    if (!cleaning && coffeeMachine.getCleanLevel() <= 0)
+      startCleaning();
+    if (cleaning)
     {
-      if (!req["coffeeStrength"].is_number_integer())
+      if (queuedOrders.size() >= CleaningCycle::MAX_QUEUED_ORDERS)
       {
-        throw 505;
-      }
-      int coffeeStrength = req["coffeeStrength"];
-
-      if (coffeeStrength < 45 || coffeeStrength > 100)
-      {
-        throw 505;
+        json res;
+        res["status"] = "Cleaning in progress and too many orders are waiting - try again later";
+        response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+        response.send(Http::Code::Service_Unavailable, res.dump(4));
+        return counterBit(ORDERS_QUEUE_FULL);
       }
+      queuedOrders.emplace_back(req, std::move(response));
+      return counterBit(ORDERS_QUEUED);
     }
-    catch (int error)
-    {
-      res["status"] = "Invalid coffee strength!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
-      return;
-    }
+
+    return brew(req, response);
+  }
+
+  // Makes the coffee of a validated order, or answers why it can't. Called with coffeeMachineLock held; returns the counters to bump.
+  unsigned brew(const json &req, Http::ResponseWriter &response)
+  {
+    json res;
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
 
     string type = req["type"];
     string cupSize = req["cupSize"];
@@ -257,10 +403,17 @@ private:
     int availableBeans = coffeeMachine.getBeansLevel();
     int cleanLevel = coffeeMachine.getCleanLevel();
 
-    json coffeeRecipes = coffeeMachine.getCoffeeRecipes();
-    int req_milkLevel = int(coffeeRecipes[type][1]);
-    int req_waterLevel = int(coffeeRecipes[type][2]);
-    int req_beansLevel = int(coffeeRecipes[type][3]);
+    // Also runs on the cleaning timer thread, where an exception would end the process: a type without a recipe is rejected
+    const json *recipe = coffeeMachine.findRecipe(type);
+    if (recipe == nullptr)
+    {
+      res["status"] = "No recipe for " + type + "!";
+      response.send(Http::Code::Bad_Request, res.dump(4));
+      return counterBit(ORDERS_INVALID);
+    }
+    int req_milkLevel = (*recipe)[CoffeeMachine::RECIPE_MILK].get<int>();
+    int req_waterLevel = (*recipe)[CoffeeMachine::RECIPE_WATER].get<int>();
+    int req_beansLevel = (*recipe)[CoffeeMachine::RECIPE_BEANS].get<int>();
 
     if (availableMilk < req_milkLevel)
     { // Aici vin resursele custom de la featureul lui Samer
@@ -281,7 +434,10 @@ private:
     if (res.contains("statusMilk") || res.contains("statusWater") || res.contains("statusBeans") || res.contains("statusClean"))
     {
       response.send(Http::Code::Bad_Request, res.dump(4));
-      return;
+      return (res.contains("statusMilk") ? counterBit(ORDERS_NO_MILK) : 0) |
+             (res.contains("statusWater") ? counterBit(ORDERS_NO_WATER) : 0) |
+             (res.contains("statusBeans") ? counterBit(ORDERS_NO_BEANS) : 0) |
+             (res.contains("statusClean") ? counterBit(ORDERS_TOO_DIRTY) : 0);
     }
 
     // Set coffee
@@ -299,7 +455,7 @@ private:
     availableBeans -= req_beansLevel; 
     coffeeMachine.setBeansLevel(availableBeans);
 
-    cleanLevel -= 5;
+    cleanLevel -= CoffeeMachine::CLEAN_LEVEL_PER_CUP;
     coffeeMachine.setCleanLevel(cleanLevel);
 
     // Fill json for response
@@ -309,21 +465,60 @@ private:
     res["foamSize"] = coffeeMachine.getFoamSize();
     res["status"] = "Coffee done :)";
 
+    unsigned counted = counterBit(ORDERS_SERVED);
+    size_t typeIndex = coffeeMachine.getCoffeeTypeIndex(type);
+    if (typeIndex < MAX_COUNTED_TYPES)
+      counted |= counterBit(ORDERS_BY_TYPE + typeIndex);
+
     // All good - send the coffee
     response.send(Http::Code::Ok, res.dump(4));
+    return counted;
+  }
+
+  void getOrderStats(const Rest::Request &request, Http::ResponseWriter response)
+  {
+    // Merges the per-thread counters
+    auto counters = orderCounters->snapshot();
+    json res;
+    res["served"] = counters[ORDERS_SERVED];
+    res["rejected"]["invalid"] = counters[ORDERS_INVALID];
+    res["rejected"]["noMilk"] = counters[ORDERS_NO_MILK];
+    res["rejected"]["noWater"] = counters[ORDERS_NO_WATER];
+    res["rejected"]["noBeans"] = counters[ORDERS_NO_BEANS];
+    res["rejected"]["tooDirty"] = counters[ORDERS_TOO_DIRTY];
+    res["rejected"]["queueFull"] = counters[ORDERS_QUEUE_FULL];
+    res["queuedForCleaning"] = counters[ORDERS_QUEUED];
+    res["servedByType"] = json::object();
+    vector<string> coffeeTypes;
+    {
+      // setCustomRecipe may add a type meanwhile
+      Guard guard(coffeeMachineLock);
+      coffeeTypes = coffeeMachine.getCoffeeTypeValues();
+    }
+    for (size_t i = 0; i < coffeeTypes.size() && i < MAX_COUNTED_TYPES; i++)
+      res["servedByType"][coffeeTypes[i]] = counters[ORDERS_BY_TYPE + i];
+
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    response.send(Http::Code::Ok, res.dump(4));
   }
 
   void cleanLevel(const Rest::Request &request, Http::ResponseWriter response)
   {
     json res;
+    Guard guard(coffeeMachineLock);
 
     // We can see how dirty the coffee machine is before cleaning it
     int cleanLevel = coffeeMachine.getCleanLevel();
-    if (cleanLevel < 10)
+    if (cleaning)
+    {
+      res["status"] = "Cleaning in progress - orders are queued until it is done";
+      addCleaningProgress(res);
+    }
+    else if (cleanLevel < CoffeeMachine::SUPER_DIRTY_THRESHOLD)
     {
       res["status"] = "Super dirty - cannot make coffee until cleaned";
     }
-    else if (cleanLevel < 30 && cleanLevel >= 10)
+    else if (cleanLevel < 30 && cleanLevel >= CoffeeMachine::SUPER_DIRTY_THRESHOLD)
     {
       res["status"] = "Dirty - will need cleaning soon";
     }
@@ -342,15 +537,83 @@ private:
     response.send(Http::Code::Ok, res.dump(4));
   }
 
+  // Starts a cleaning cycle, unless the server is shutting down. Called with coffeeMachineLock held.
+  void startCleaning()
+  {
+    if (shuttingDown)
+      return;
+    cleaning = true;
+    cleaningCycle->start();
+  }
+
+  // End of a cleaning cycle, on the cleaning timer thread
+  void finishCleaning()
+  {
+    vector<unsigned> outcomes;
+    {
+      Guard guard(coffeeMachineLock);
+      coffeeMachine.setCleanLevel(100);
+
+      // Orders that waited for the cycle are made in arrival order
+      while (!queuedOrders.empty())
+      {
+        // So many orders waited that the machine is dirty again: the rest waits for another cycle
+        if (coffeeMachine.getCleanLevel() <= 0)
+        {
+          cleaningCycle->start();
+          break;
+        }
+        auto order = std::move(queuedOrders.front());
+        queuedOrders.pop_front();
+        outcomes.push_back(brew(order.first, order.second));
+      }
+      if (queuedOrders.empty())
+        cleaning = false;
+    }
+    for (unsigned counted : outcomes)
+      countOrder(counted);
+  }
+
+  // Idle tick of the cleaning timer: cleans a dirty machine while nobody is ordering
+  void autoClean()
+  {
+    Guard guard(coffeeMachineLock);
+    if (!cleaning && coffeeMachine.getCleanLevel() < CleaningCycle::AUTO_CLEAN_LEVEL &&
+        std::chrono::steady_clock::now() - lastOrder >= CleaningCycle::AUTO_CLEAN_IDLE)
+      startCleaning();
+  }
+
+  // Adds the progress of the running cleaning cycle to a response. Called with coffeeMachineLock held.
+  void addCleaningProgress(json &res)
+  {
+    res["phase"] = CleaningCycle::getPhaseName(cleaningCycle->getPhase());
+    res["secondsRemaining"] = (cleaningCycle->getRemaining().count() + 999) / 1000;
+    res["queuedOrders"] = queuedOrders.size();
+  }
+
   void clean(const Rest::Request &request, Http::ResponseWriter response)
   {
-    // We can see how dirty the coffee machine is before cleaning it
-    int cleanLevel = coffeeMachine.getCleanLevel();
+    if (!authorize(request, response))
+      return;
+
+    Guard guard(coffeeMachineLock);
     json res;
-    if (cleanLevel < 70)
+    if (shuttingDown)
     {
-      coffeeMachine.setCleanLevel(100);
-      res["status"] = "Your coffee machine was cleaned";
+      res["status"] = "Coffee machine is shutting down";
+      response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+      response.send(Http::Code::Service_Unavailable, res.dump(4));
+      return;
+    }
+    if (cleaning)
+    {
+      res["status"] = "Your coffee machine is already being cleaned";
+    }
+    // The machine is only cleaned when it is dirty enough
+    else if (coffeeMachine.getCleanLevel() < CoffeeMachine::CLEAN_THRESHOLD)
+    {
+      startCleaning();
+      res["status"] = "Your coffee machine is being cleaned";
     }
     else
     {
@@ -358,6 +621,8 @@ private:
     }
     // Create a json for response
     res["cleanLevel"] = coffeeMachine.getCleanLevel();
+    if (cleaning)
+      addCleaningProgress(res);
 
     //need to add this everytime
     response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
@@ -369,6 +634,7 @@ private:
   void getLedStrip(const Rest::Request &request, Http::ResponseWriter response)
   {
     json res;
+    Guard guard(coffeeMachineLock);
     // See led strip status
     string color;
     bool state = coffeeMachine.getLedStripState();
@@ -392,54 +658,39 @@ private:
 
   void setLedStrip(const Rest::Request &request, Http::ResponseWriter response)
   {
-    // Need to explicitly use json::parse (not just = request.body()) or else it won't work :/
-    json req = json::parse(request.body());
+    json req;
+    if (!authorize(request, response) || !parseBody(request, response, req) || !validateBody(req, ledStripRules, "Setting LedStrip failed!", response))
+      return;
     cout << req.dump(4); //4 spaces as tab in json
+    Guard guard(coffeeMachineLock);
 
-    string color=req["color"];
-    
+    bool state = req["state"];
+    string color = req["color"];
 
     json res;
-    
-    //need to add this everytime
-    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
-   try{
-    bool state = req["state"];
-    //validate input wih regex
-    if ( regex_match (color, regex("#[a-fA-F0-9]{6}") ))
-    { 
-          if (!state)
-          {
-            coffeeMachine.setLedStripState(false);
-            res["status"] = "LedStrip is off";
-          }
-          else 
-          {
-            coffeeMachine.setLedStripState(true);
-            coffeeMachine.setLedStripColor(color);
-            res["status"]="LedStrip is on with color "+color;
-          }  
-          //send back json response
-          response.send(Http::Code::Ok, res.dump(4));
+    if (!state)
+    {
+      coffeeMachine.setLedStripState(false);
+      res["status"] = "LedStrip is off";
     }
     else
-    { 
-       //send back json response
-       res["status"] = "Color validation failed!";
-       response.send(Http::Code::Bad_Request, res.dump(4));
-    }
-   }
-   catch(exception e)
-   {
-    res["status"] = "Setting LedStrip failed!";
-    response.send(Http::Code::Bad_Request, res.dump(4));
-   }
+    {
+      coffeeMachine.setLedStripState(true);
+      coffeeMachine.setLedStripColor(color);
+      res["status"] = "LedStrip is on with color " + color;
+    }
+
+    //need to add this everytime
+    response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
+    //send back json response
+    response.send(Http::Code::Ok, res.dump(4));
   }
 
 
   void getRefillResourceLevels(const Rest::Request &request, Http::ResponseWriter response)
   {
     json res;
+    Guard guard(coffeeMachineLock);
 
     int milkLevel = coffeeMachine.getMilkLevel();
     int waterLevel = coffeeMachine.getWaterLevel();
@@ -449,7 +700,7 @@ private:
     res["waterLevel"] = "Water level : " + to_string(waterLevel) + " %";
     res["beansLevel"] = "Beans level : " + to_string(beansLevel) + " %";
 
-    res["status"] = (milkLevel < 30 || waterLevel < 30 || beansLevel < 30) ? "One or more resource levels need a refill" : "Resource levels are good";
+    res["status"] = (milkLevel < CoffeeMachine::REFILL_THRESHOLD || waterLevel < CoffeeMachine::REFILL_THRESHOLD || beansLevel < CoffeeMachine::REFILL_THRESHOLD) ? "One or more resource levels need a refill" : "Resource levels are good";
 
     response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
     response.send(Http::Code::Ok, res.dump(4));
@@ -457,335 +708,117 @@ private:
 
   void refillResourceLevel(const Rest::Request &request, Http::ResponseWriter response)
   {
-    json req = json::parse(request.body());
+    json req;
+    if (!authorize(request, response) || !parseBody(request, response, req) || !validateBody(req, refillRules, "Invalid refill request!", response))
+      return;
     cout << req.dump(4); //4 spaces as tab in json
+    Guard guard(coffeeMachineLock);
 
     json res;
+    string resourceType = req["resourceType"];
 
-    try
+    if (resourceType == "MILK")
     {
-      if (!req["resourceType"].is_string())
+      if (coffeeMachine.getMilkLevel() > 99)
       {
-        throw 505;
+        res["status"] = "Milk level is already full.";
       }
-
-      string resourceType = req["resourceType"];
-
-      if (resourceType == "MILK")
-      {
-        if (coffeeMachine.getMilkLevel() > 99)
-        {
-          res["status"] = "Milk level is already full.";
-        }
-        else
-        {
-          coffeeMachine.setMilkLevel(100);
-          res["status"] = "Milk level has been refilled.";
-        }
-      }
-      else if (resourceType == "WATER")
+      else
       {
-        if (coffeeMachine.getWaterLevel() > 99)
-        {
-          res["status"] = "Water level is already full.";
-        }
-        else
-        {
-          coffeeMachine.setWaterLevel(100);
-          res["status"] = "Water level has been refilled.";
-        }
+        coffeeMachine.setMilkLevel(100);
+        res["status"] = "Milk level has been refilled.";
       }
-      else if (resourceType == "BEANS")
+    }
+    else if (resourceType == "WATER")
+    {
+      if (coffeeMachine.getWaterLevel() > 99)
       {
-        if (coffeeMachine.getBeansLevel() > 99)
-        {
-          res["status"] = "Beans level is already full.";
-        }
-        else
-        {
-          coffeeMachine.setBeansLevel(100);
-          res["status"] = "Beans level has been refilled.";
-        }
+        res["status"] = "Water level is already full.";
       }
       else
       {
-        throw 505;
+        coffeeMachine.setWaterLevel(100);
+        res["status"] = "Water level has been refilled.";
       }
     }
-    catch (int error)
+    else if (resourceType == "BEANS")
     {
-      res["status"] = "Invalid resource type!";
-      response.send(Http::Code::Bad_Request, res.dump(4));
-      return;
+      if (coffeeMachine.getBeansLevel() > 99)
+      {
+        res["status"] = "Beans level is already full.";
+      }
+      else
+      {
+        coffeeMachine.setBeansLevel(100);
+        res["status"] = "Beans level has been refilled.";
+      }
     }
 
     response.headers().add<Pistache::Http::Header::ContentType>(MIME(Application, Json));
     response.send(Http::Code::Ok, res.dump(4));
   }
 
-  // Defining the class of the CoffeeMachine. It should model the entire configuration of the CoffeeMachine
-  class CoffeeMachine
-  {
-  public:
-    explicit CoffeeMachine() {}
-
-    // COFFEE TYPE
-    // Setter
-    void setCoffeeType(string value)
-    {
-      // Find index of coffee type string
-      auto it = find(coffeeTypeString.begin(), coffeeTypeString.end(), value);
-
-      if (it != coffeeTypeString.end())
-      {                                               // If found
-        int index = it - coffeeTypeString.begin();    // Get index
-        coffeeType = static_cast<COFFEE_TYPE>(index); // Int to enum
-      }
-      // We could return 0 or 1 depending if enum was found and set
-    }
-
-    // Getter
-    string getCoffeeType()
-    {
-      return coffeeTypeString[coffeeType];
-    }
-
-    // CUP SIZE
-    // Setter
-    void setCupSize(string value)
-    {
-      // Find index of coffee type string
-      auto it = find(cupSizeString.begin(), cupSizeString.end(), value);
-
-      if (it != cupSizeString.end())
-      {                                         // If found
-        int index = it - cupSizeString.begin(); // Get index
-        cupSize = static_cast<CUP_SIZE>(index); // Int to enum
-      }
-      // We could return 0 or 1 depending if enum was found and set
-    }
-
-    // Getter
-    string getCupSize()
-    {
-      return cupSizeString[cupSize];
-    }
-
-    // FOAM SIZE
-    // Setter
-    void setFoamSize(string value)
-    {
-      // Find index of coffee type string
-      auto it = find(foamSizeString.begin(), foamSizeString.end(), value);
-
-      if (it != foamSizeString.end())
-      {                                           // If found
-        int index = it - foamSizeString.begin();  // Get index
-        foamSize = static_cast<FOAM_SIZE>(index); // Int to enum
-      }
-      // We could return 0 or 1 depending if enum was found and set
-    }
-
-    // Getter
-    string getFoamSize()
-    {
-      return foamSizeString[foamSize];
-    }
-
-    // COFFEE STRENGTH
-    // Setter
-    void setCoffeeStrength(int value)
-    {
-      coffeeStrength = value;
-    }
-
-    // Getter
-    int getCoffeeStrength()
-    {
-      return coffeeStrength;
-    }
-
-    // MILK
-    // Setter
-    void setMilkLevel(int value)
-    {
-      milkLevel = value;
-    }
-
-    // Getter
-    int getMilkLevel()
-    {
-      return milkLevel;
-    }
-
-    // WATER
-    // Setter
-    void setWaterLevel(int value)
-    {
-      waterLevel = value;
-    }
-
-    // Getter
-    int getWaterLevel()
-    {
-      return waterLevel;
-    }
-
-    // BEANS
-    // Setter
-    void setBeansLevel(int value)
-    {
-      beansLevel = value;
-    }
-
-    // Getter
-    int getBeansLevel()
-    {
-      return beansLevel;
-    }
-
-    // Clean
-    // Setter
-    void setCleanLevel(int value)
-    {
-      cleanLevel = value;
-    }
-
-    // Getter
-    int getCleanLevel()
-    {
-      return cleanLevel;
-    }
-
-    // LedStrip
-    // Setter
-    void setLedStripState(bool value)
-    {
-      ledStrip = value;
-    }
-
-    // Getter
-    bool getLedStripState()
-    {
-      return ledStrip;
-    }
-
-    // LedStrip color
-    // Setter
-    void setLedStripColor(string value)
-    {
-      ledStripcolor = value;
-    }
-
-    // Getter
-    string getLedStripColor()
-    {
-      return ledStripcolor;
-    }
-    
-    vector<string> getCoffeeTypeValues()
-    {
-      return coffeeTypeString;
-    }
-
-    vector<string> getCupSizeValues()
-    {
-      return cupSizeString;
-    }
-
-    vector<string> getFoamSizeValues()
-    {
-      return foamSizeString;
-    }
-
-    vector<string> getResourceTypeValues()
-    {
-      return resourceTypeString;
-    }
-    json getCoffeeRecipes()
-    {
-      return coffeeRecipes;
-    }
-    void setCustomRecipe(vector<int> ingredients)
-    {
-      coffeeTypeString.push_back("CUSTOM");
-      coffeeRecipes["CUSTOM"] = ingredients;
-    }
-
-  private:
-    // Defining and instantiating settings.
-    enum COFFEE_TYPE
-    {
-      CAPPUCCINO,
-      ESPRESSO,
-      LATTE_MACHIATTO,
-      CAFFE_LATTE,
-      DOPPIO,
-      AMERICANO
-    } coffeeType = COFFEE_TYPE::CAFFE_LATTE;
-
-    // Can't find another easy way to convert string to enum and back so I'm gonna use this
-    vector<string> coffeeTypeString =
-        {"CAPPUCCINO", "ESPRESSO", "LATTE_MACHIATTO", "CAFFE_LATTE", "DOPPIO", "AMERICANO"};
-
-    vector<string> resourceTypeString =
-        {"MILK", "WATER", "BEANS"};
-
-    //Enum names are in global scope so they must be unique => cant have CUP_SIZE::S and FOAM_SIZE::S
-    enum CUP_SIZE
-    {
-      CUP_S,
-      CUP_M,
-      CUP_L,
-      CUP_XL
-    } cupSize = CUP_SIZE::CUP_S;
-
-    vector<string> cupSizeString =
-        {"CUP_S", "CUP_M", "CUP_L", "CUP_XL"};
-
-    enum FOAM_SIZE
-    {
-      FOAM_S,
-      FOAM_M,
-      FOAM_L
-    } foamSize = FOAM_SIZE::FOAM_S;
-
-    vector<string> foamSizeString =
-        {"FOAM_S", "FOAM_M", "FOAM_L"};
-
-    int coffeeStrength = 45; // 45mg - 100mg
-
-    int milkLevel = 100; // 0 - 100
-
-    int waterLevel = 100; // 0 - 100
-
-    int beansLevel = 100; // 0 - 100
-
-    int cleanLevel = 100; // 0 - 100
-
-    bool ledStrip = false;
-
-    string ledStripcolor;
-
-    json coffeeRecipes = {
-        {"CAPPUCCINO", {50, 5, 10, 5}},
-        {"ESPRESSO", {100, 0, 10, 5}},
-        {"LATTE_MACHIATTO", {50, 10, 10, 5}},
-        {"DOPPIO", {100, 0, 7, 10}},
-        {"AMERICANO", {60, 8, 7, 5}}};
-  };
-
   // Create the lock which prevents concurrent editing of the same variable
   using Lock = std::mutex;
   using Guard = std::lock_guard<Lock>;
   Lock coffeeMachineLock;
 
+  // Cleaning cycle state, guarded by coffeeMachineLock. cleaning stays set until the queued orders are made.
+  bool cleaning = false;
+  bool shuttingDown = false; // set by stop(); from then on nothing is queued and no cycle starts
+  deque<pair<json, Http::ResponseWriter>> queuedOrders;
+  std::chrono::steady_clock::time_point lastOrder = std::chrono::steady_clock::now();
+  CleaningCycle::Durations cleaningDurations;
+
+  // Validation tables used by the POST handlers
+  // Accepted coffee types, replaced as a whole (std::atomic_store) when a custom recipe is added
+  std::shared_ptr<const vector<string>> coffeeTypes;
+  vector<OrderValidator::Rule> coffeeOrderRules;
+  vector<OrderValidator::Rule> customRecipeRules;
+  vector<OrderValidator::Rule> refillRules;
+  vector<OrderValidator::Rule> ledStripRules;
+
+  // Order counters, kept per worker thread so the hot path never shares a cache line
+  enum OrderCounter
+  {
+    ORDERS_SERVED,
+    ORDERS_INVALID,
+    ORDERS_NO_MILK,
+    ORDERS_NO_WATER,
+    ORDERS_NO_BEANS,
+    ORDERS_TOO_DIRTY,
+    ORDERS_QUEUED,     // waited for a cleaning cycle
+    ORDERS_QUEUE_FULL, // rejected because too many orders were waiting
+    ORDERS_BY_TYPE,    // one counter per coffee type, in getCoffeeTypeValues order
+    MAX_COUNTED_TYPES = 8,
+    ORDER_COUNTERS = ORDERS_BY_TYPE + MAX_COUNTED_TYPES
+  };
+  static_assert(ORDER_COUNTERS <= 32, "countOrder passes the counters of an order as bits of an unsigned");
+  std::unique_ptr<ShardedCounters<ORDER_COUNTERS>> orderCounters;
+
+  // Signs and verifies the session tokens handed out by /auth
+  SessionTokens sessionTokens;
+
   // Instance of the microwave model // I think you mean coffee machine model
   CoffeeMachine coffeeMachine;
 
+  // Request recorder, only set while capturing traffic
+  std::unique_ptr<TrafficCapture::Writer> trafficCapture;
+
+  // Webhook notifications, only set when webhooks are configured
+  std::unique_ptr<WebhookDispatcher> webhooks;
+
+  // TLS certificate and key files, HTTPS is off while empty
+  string tlsCertificate;
+  string tlsKey;
+  bool tlsEnabled = false; // set once useSSL was called
+
   // Defining the httpEndpoint and a router.
   std::shared_ptr<Http::Endpoint> httpEndpoint;
   Rest::Router router;
+
+  // Declared last so its timer thread is stopped before the state it uses is destroyed
+  std::unique_ptr<CleaningCycle> cleaningCycle;
 };
 
 int main(int argc, char *argv[])
@@ -821,6 +854,77 @@ int main(int argc, char *argv[])
   // Instance of the class that defines what the server can do.
   CoffeeMachineController stats(addr);
 
+  // Shared secret for the session tokens, otherwise a random one is generated on startup
+  if (const char *secret = getenv("COFFEE_MACHINE_SECRET"))
+  {
+    // An empty HMAC key would let anyone sign tokens
+    if (*secret == '\0')
+    {
+      cerr << "COFFEE_MACHINE_SECRET is empty, unset it or give it a secret value" << endl;
+      return 1;
+    }
+    stats.setSessionSecret(secret);
+  }
+
+  // Serve HTTPS when both a certificate and its key are given
+  const char *certificate = getenv("COFFEE_MACHINE_CERT");
+  const char *key = getenv("COFFEE_MACHINE_KEY");
+  if (certificate || key)
+  {
+    // Asked for HTTPS: refuse to start rather than silently serve plain HTTP
+    if (!certificate || !key)
+    {
+      cerr << "Set both COFFEE_MACHINE_CERT and COFFEE_MACHINE_KEY to serve HTTPS" << endl;
+      return 1;
+    }
+    if (!stats.useTls(certificate, key))
+    {
+      cerr << "HTTPS requested but Pistache was built without SSL support (PISTACHE_USE_SSL)" << endl;
+      return 1;
+    }
+    cout << "Using TLS certificate " << certificate << endl;
+  }
+
+  // Record the incoming traffic for later replay
+  if (const char *capture = getenv("COFFEE_MACHINE_CAPTURE"))
+  {
+    if (stats.captureTraffic(capture))
+      cout << "Capturing traffic to " << capture << endl;
+    else
+      cerr << "Cannot open capture file " << capture << endl;
+  }
+
+  // Comma separated webhook URLs notified when resources run low or the machine gets too dirty
+  if (const char *webhookList = getenv("COFFEE_MACHINE_WEBHOOKS"))
+  {
+    vector<string> urls;
+    stringstream list(webhookList);
+    for (string url; getline(list, url, ',');)
+      if (!url.empty())
+        urls.push_back(url);
+
+    char hostname[256] = "coffee-machine";
+    gethostname(hostname, sizeof(hostname) - 1);
+    const char *machine = getenv("COFFEE_MACHINE_ID");
+    stats.notifyWebhooks(urls, machine ? string(machine) : string(hostname) + ":" + to_string(static_cast<uint16_t>(port)));
+  }
+
+  // Cleaning cycle phases in seconds: "rinse,descale,dry"
+  if (const char *cycle = getenv("COFFEE_MACHINE_CLEAN_CYCLE"))
+  {
+    CleaningCycle::Durations durations;
+    int rinse, descale, dry;
+    if (sscanf(cycle, "%d,%d,%d", &rinse, &descale, &dry) == 3)
+    {
+      durations.rinse = std::chrono::seconds(rinse);
+      durations.descale = std::chrono::seconds(descale);
+      durations.dry = std::chrono::seconds(dry);
+      stats.setCleaningDurations(durations);
+    }
+    else
+      cerr << "Ignoring COFFEE_MACHINE_CLEAN_CYCLE, expected rinse,descale,dry in seconds" << endl;
+  }
+
   // Initialize and start the server
   stats.init(thr);
   stats.start();
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Minimal blocking HTTP/1.1 client over one keep-alive connection (plain HTTP only).
+// Used by the tools and by the webhook dispatcher, which both run outside the Pistache threads.
+class HttpConnection
+{
+public:
+  // timeoutMs bounds every connect/send/receive, 0 waits forever
+  HttpConnection(const std::string &host, const std::string &port, int timeoutMs = 0)
+      : host(host), port(port), timeoutMs(timeoutMs) {}
+
+  ~HttpConnection()
+  {
+    disconnect();
+  }
+
+  // Splits "http://host[:port][/path]" into its parts. Returns false for anything else.
+  static bool parseUrl(const std::string &url, std::string &host, std::string &port, std::string &path)
+  {
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0)
+      return false;
+    size_t hostStart = scheme.size();
+    size_t pathStart = url.find('/', hostStart);
+    std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+    size_t colon = authority.rfind(':');
+    host = authority.substr(0, colon);
+    port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+    path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+    return !host.empty() && !port.empty();
+  }
+
+  // Sends the request and waits for the answer, reconnecting once if the server closed the connection.
+  // Returns the HTTP status code, or 0 on failure.
+  int send(const std::string &method, const std::string &route, const std::string &body, const std::string &cookie, std::string &responseBody)
+  {
+    std::string request = method + " " + route + " HTTP/1.1\r\nHost: " + host + "\r\n";
+    if (!cookie.empty())
+      request += "Cookie: " + cookie + "\r\n";
+    if (method == "POST")
+      request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    request += "\r\n" + body;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+      if (fd < 0 && !connectToServer())
+        return 0;
+      int status = exchange(request, responseBody);
+      if (status != 0)
+        return status;
+      disconnect();
+    }
+    return 0;
+  }
+
+  // Set-Cookie header of the last response
+  const std::string &getSetCookie() const
+  {
+    return setCookie;
+  }
+
+private:
+  bool connectToServer()
+  {
+    addrinfo hints = {}, *result = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+      return false;
+
+    timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    for (addrinfo *it = result; it != nullptr && fd < 0; it = it->ai_next)
+    {
+      fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+      if (fd < 0)
+        continue;
+      // On Linux SO_SNDTIMEO also bounds connect()
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      if (connect(fd, it->ai_addr, it->ai_addrlen) != 0)
+      {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(result);
+
+    int noDelay = 1;
+    if (fd >= 0)
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    buffer.clear();
+    return fd >= 0;
+  }
+
+  void disconnect()
+  {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+
+  int exchange(const std::string &request, std::string &responseBody)
+  {
+    for (size_t sent = 0; sent < request.size();)
+    {
+      ssize_t n = ::send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0)
+        return 0;
+      sent += n;
+    }
+
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+      if (!receive())
+        return 0;
+
+    std::string headers = buffer.substr(0, headerEnd);
+    size_t statusStart = headers.find(' ');
+    if (statusStart == std::string::npos)
+      return 0;
+    int status = atoi(headers.c_str() + statusStart + 1);
+    size_t contentLength = 0;
+    setCookie.clear();
+    for (size_t line = headers.find("\r\n"); line != std::string::npos; line = headers.find("\r\n", line + 2))
+    {
+      size_t lineEnd = headers.find("\r\n", line + 2);
+      size_t colon = headers.find(':', line);
+      if (colon == std::string::npos || colon > lineEnd)
+        continue;
+      std::string name = headers.substr(line + 2, colon - line - 2);
+      size_t valueStart = std::min(headers.find_first_not_of(' ', colon + 1), lineEnd);
+      std::string value = headers.substr(valueStart, lineEnd - valueStart);
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      if (name == "content-length")
+        contentLength = strtoul(value.c_str(), nullptr, 10);
+      else if (name == "set-cookie")
+        setCookie += (setCookie.empty() ? "" : "; ") + value.substr(0, value.find(';'));
+    }
+
+    while (buffer.size() < headerEnd + 4 + contentLength)
+      if (!receive())
+        return 0;
+    responseBody = buffer.substr(headerEnd + 4, contentLength);
+    buffer.erase(0, headerEnd + 4 + contentLength);
+    return status;
+  }
+
+  bool receive()
+  {
+    char chunk[16384];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0)
+      return false;
+    buffer.append(chunk, n);
+    return true;
+  }
+
+  std::string host;
+  std::string port;
+  int timeoutMs;
+  int fd = -1;
+  std::string buffer;
+  std::string setCookie;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+// Table-driven validation of request bodies.
+// Every rule is checked (no early exit) and no exceptions are thrown, so a bad
+// request costs the same few comparisons as a good one and the client gets all
+// of its mistakes back in one response.
+class OrderValidator
+{
+public:
+  enum RuleKind
+  {
+    ONE_OF,    // field must be a string contained in "allowed"
+    INT_RANGE, // field must be an integer in [min, max]
+    ONE_OF_CURRENT, // like ONE_OF, against the list "current" points to at the time of the check
+    BOOLEAN,   // field must be true or false
+    MATCHES    // field must be a string matching "pattern" as a whole
+  };
+
+  struct Rule
+  {
+    std::string field;
+    RuleKind kind;
+    std::vector<std::string> allowed;
+    int min;
+    int max;
+    std::string status; // message reported when the rule fails
+    std::regex pattern;
+    const std::shared_ptr<const std::vector<std::string>> *current;
+    std::string errorEntry; // this rule's entry of the errors array, pre-rendered by withErrorEntry
+  };
+
+  static Rule oneOf(std::string field, std::vector<std::string> allowed, std::string status)
+  {
+    return withErrorEntry(Rule{std::move(field), ONE_OF, std::move(allowed), 0, 0, std::move(status)});
+  }
+
+  static Rule intRange(std::string field, int min, int max, std::string status)
+  {
+    return withErrorEntry(Rule{std::move(field), INT_RANGE, {}, min, max, std::move(status)});
+  }
+
+  // For accepted values that change while requests are validated: the owner replaces the list with
+  // std::atomic_store and every check reads it with std::atomic_load, so the rule table itself never changes
+  static Rule oneOfCurrent(std::string field, const std::shared_ptr<const std::vector<std::string>> &current, std::string status)
+  {
+    return withErrorEntry(Rule{std::move(field), ONE_OF_CURRENT, {}, 0, 0, std::move(status), std::regex(), &current});
+  }
+
+  static Rule boolean(std::string field, std::string status)
+  {
+    return withErrorEntry(Rule{std::move(field), BOOLEAN, {}, 0, 0, std::move(status)});
+  }
+
+  // The pattern is compiled once here, not on every request
+  static Rule matches(std::string field, const std::string &pattern, std::string status)
+  {
+    return withErrorEntry(Rule{std::move(field), MATCHES, {}, 0, 0, std::move(status), std::regex(pattern)});
+  }
+
+  // Parses a request body without throwing. Returns false for malformed JSON
+  // or for anything that is not a JSON object.
+  static bool parse(const std::string &body, nlohmann::json &out)
+  {
+    out = nlohmann::json::parse(body, nullptr, false);
+    return !out.is_discarded() && out.is_object();
+  }
+
+  // Checks every rule without allocating anything. Bit i of the result is set when rules[i] failed,
+  // so 0 means the request passed. A table holds at most 32 rules.
+  static uint32_t validate(const nlohmann::json &req, const std::vector<Rule> &rules)
+  {
+    uint32_t failed = 0;
+    for (size_t i = 0; i < rules.size() && i < 32; i++)
+      if (!check(req, rules[i]))
+        failed |= uint32_t(1) << i;
+    return failed;
+  }
+
+  // The 400 body for the failed rules, byte for byte what json::dump(4) makes of
+  // {"status": status, "errors": [{"field", "status"}, ...]}, assembled from the pre-rendered
+  // entries so rejecting a request does not build a json object per violation
+  static std::string errorResponse(const std::vector<Rule> &rules, uint32_t failed, const std::string &status)
+  {
+    std::string body = "{\n    \"errors\": [";
+    const char *separator = "\n";
+    for (size_t i = 0; i < rules.size() && i < 32; i++)
+      if (failed & (uint32_t(1) << i))
+      {
+        body += separator;
+        body += rules[i].errorEntry;
+        separator = ",\n";
+      }
+    body += "\n    ],\n    \"status\": " + nlohmann::json(status).dump() + "\n}";
+    return body;
+  }
+
+private:
+  static Rule withErrorEntry(Rule rule)
+  {
+    rule.errorEntry = "        {\n            \"field\": " + nlohmann::json(rule.field).dump() +
+                      ",\n            \"status\": " + nlohmann::json(rule.status).dump() + "\n        }";
+    return rule;
+  }
+
+  static bool check(const nlohmann::json &req, const Rule &rule)
+  {
+    // find() instead of operator[] so a missing field is not inserted (or thrown on)
+    auto it = req.find(rule.field);
+    if (it == req.end())
+      return false;
+
+    if (rule.kind == ONE_OF)
+    {
+      const std::string *value = it->get_ptr<const std::string *>();
+      return value != nullptr && find(rule.allowed.begin(), rule.allowed.end(), *value) != rule.allowed.end();
+    }
+    if (rule.kind == ONE_OF_CURRENT)
+    {
+      const std::string *value = it->get_ptr<const std::string *>();
+      if (value == nullptr)
+        return false;
+      std::shared_ptr<const std::vector<std::string>> allowed = std::atomic_load(rule.current);
+      return find(allowed->begin(), allowed->end(), *value) != allowed->end();
+    }
+    if (rule.kind == BOOLEAN)
+      return it->is_boolean();
+    if (rule.kind == MATCHES)
+    {
+      const std::string *value = it->get_ptr<const std::string *>();
+      return value != nullptr && std::regex_match(*value, rule.pattern);
+    }
+
+    if (!it->is_number_integer())
+      return false;
+    long long value = it->get<long long>();
+    return value >= rule.min && value <= rule.max;
+  }
+};
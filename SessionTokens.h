@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+// Issues and verifies expiring session tokens of the form "<expiry>.<nonce>.<hmac>",
+// where hmac = HMAC-SHA256(secret, "<expiry>.<nonce>") in hex.
+// Recently verified tokens are kept in a sharded cache so the common case (a kiosk
+// sending the same token over and over) skips the HMAC computation.
+class SessionTokens
+{
+public:
+  explicit SessionTokens(long ttlSeconds = 3600) : ttl(ttlSeconds)
+  {
+    unsigned char random[32];
+    randomBytes(random, sizeof(random));
+    secret.assign(reinterpret_cast<char *>(random), sizeof(random));
+  }
+
+  // Every instance sharing the same secret accepts the same tokens. Call before the server is started.
+  void setSecret(const std::string &value)
+  {
+    secret = value;
+    for (Shard &shard : shards)
+    {
+      std::lock_guard<std::mutex> guard(shard.lock);
+      shard.verified.clear();
+    }
+  }
+
+  long getTtl() const
+  {
+    return ttl;
+  }
+
+  std::string issue()
+  {
+    unsigned char random[16];
+    randomBytes(random, sizeof(random));
+    std::string payload = std::to_string(now() + ttl) + "." + toHex(random, sizeof(random));
+    return payload + "." + sign(payload);
+  }
+
+  bool verify(const std::string &token)
+  {
+    long current = now();
+    Shard &shard = shards[std::hash<std::string>()(token) % SHARDS];
+    {
+      std::lock_guard<std::mutex> guard(shard.lock);
+      auto it = shard.verified.find(token);
+      if (it != shard.verified.end())
+      {
+        if (it->second > current)
+          return true;
+        shard.verified.erase(it);
+        return false;
+      }
+    }
+
+    // Cache miss: check the expiry and the signature
+    size_t macStart = token.rfind('.');
+    if (macStart == std::string::npos || macStart == 0)
+      return false;
+    std::string payload = token.substr(0, macStart);
+
+    char *end = nullptr;
+    long expiry = strtol(payload.c_str(), &end, 10);
+    if (end == payload.c_str() || *end != '.' || expiry <= current)
+      return false;
+
+    std::string expected = sign(payload);
+    if (token.size() - macStart - 1 != expected.size() ||
+        CRYPTO_memcmp(token.data() + macStart + 1, expected.data(), expected.size()) != 0)
+      return false;
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (shard.verified.size() >= SHARD_CAPACITY)
+      evictExpired(shard, current);
+    shard.verified[token] = expiry;
+    return true;
+  }
+
+private:
+  static const size_t SHARDS = 16;
+  static const size_t SHARD_CAPACITY = 1024;
+
+  // A secret or nonce that is not random would make the tokens guessable, so there is no fallback
+  static void randomBytes(unsigned char *buffer, int size)
+  {
+    if (RAND_bytes(buffer, size) != 1)
+    {
+      fputs("SessionTokens: RAND_bytes failed, cannot generate session tokens safely\n", stderr);
+      abort();
+    }
+  }
+
+  // Each shard sits on its own cache line so threads hitting different shards don't contend
+  struct alignas(64) Shard
+  {
+    std::mutex lock;
+    std::unordered_map<std::string, long> verified; // token -> expiry
+  };
+
+  static long now()
+  {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static std::string toHex(const unsigned char *data, size_t size)
+  {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; i++)
+    {
+      hex[2 * i] = digits[data[i] >> 4];
+      hex[2 * i + 1] = digits[data[i] & 0xf];
+    }
+    return hex;
+  }
+
+  std::string sign(const std::string &payload) const
+  {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int macSize = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char *>(payload.data()), payload.size(), mac, &macSize);
+    return toHex(mac, macSize);
+  }
+
+  static void evictExpired(Shard &shard, long current)
+  {
+    for (auto it = shard.verified.begin(); it != shard.verified.end();)
+    {
+      if (it->second <= current)
+        it = shard.verified.erase(it);
+      else
+        ++it;
+    }
+    // Still full of live tokens: start over, they will be re-verified on their next use
+    if (shard.verified.size() >= SHARD_CAPACITY)
+      shard.verified.clear();
+  }
+
+  long ttl;
+  std::string secret;
+  Shard shards[SHARDS];
+};
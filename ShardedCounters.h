@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+// N counters split into per-thread slots, each on its own cache line(s); readers merge all the slots.
+// Meant for hot counters that are read rarely (stats endpoints).
+// Threads get process-wide indices that are never reused, and thread i writes slot i % slots. With at least as many
+// slots as threads that ever count, no two writers share a cache line; beyond that threads share slots, which keeps the
+// counts exact but can bounce the shared line.
+template <size_t N>
+class ShardedCounters
+{
+public:
+  // slots should be at least the number of threads that ever update counters of this size
+  explicit ShardedCounters(size_t slots = std::thread::hardware_concurrency())
+      : slotCount(std::max<size_t>(1, slots)), slots(new Slot[slotCount]) {}
+
+  void add(size_t counter, long value = 1)
+  {
+    slots[threadIndex() % slotCount].values[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  long get(size_t counter) const
+  {
+    long total = 0;
+    for (size_t s = 0; s < slotCount; s++)
+      total += slots[s].values[counter].load(std::memory_order_relaxed);
+    return total;
+  }
+
+  // All counters merged in one pass over the slots
+  std::array<long, N> snapshot() const
+  {
+    std::array<long, N> totals{};
+    for (size_t s = 0; s < slotCount; s++)
+      for (size_t c = 0; c < N; c++)
+        totals[c] += slots[s].values[c].load(std::memory_order_relaxed);
+    return totals;
+  }
+
+private:
+  struct alignas(64) Slot
+  {
+    std::atomic<long> values[N] = {};
+  };
+
+  // Threads are numbered in the order they first update a counter of any ShardedCounters<N>
+  static size_t threadIndex()
+  {
+    static std::atomic<size_t> nextIndex{0};
+    thread_local size_t index = nextIndex++;
+    return index;
+  }
+
+  size_t slotCount;
+  std::unique_ptr<Slot[]> slots;
+};
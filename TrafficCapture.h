@@ -0,0 +1,213 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+
+// Binary capture of incoming requests, replayed by tools/TrafficReplay.
+//
+// File layout (native byte order):
+//   "CMCAP001"                        8 bytes magic
+//   int64  start time, microseconds since the epoch
+//   then one record per request:
+//   uint64 microseconds since start
+//   uint8  method (TrafficCapture::GET / POST / OTHER)
+//   uint16 route length, uint32 body length
+//   route bytes, body bytes
+namespace TrafficCapture
+{
+  enum Method : uint8_t
+  {
+    GET,
+    POST,
+    OTHER
+  };
+
+  static const char MAGIC[8] = {'C', 'M', 'C', 'A', 'P', '0', '0', '1'};
+  static const size_t RECORD_HEADER_SIZE = 8 + 1 + 2 + 4;
+
+  struct Request
+  {
+    uint64_t timestamp; // microseconds since the capture started
+    Method method;
+    std::string route;
+    std::string body;
+  };
+
+  // Request threads only append to an in-memory buffer; a background thread writes it to disk.
+  // When the disk can't keep up the buffer is capped and further requests are dropped (and counted)
+  // instead of slowing the server down.
+  class Writer
+  {
+  public:
+    explicit Writer(const std::string &path, size_t maxBuffered = 16 << 20)
+        : maxBuffered(maxBuffered), start(std::chrono::steady_clock::now())
+    {
+      file = fopen(path.c_str(), "wb");
+      if (file == nullptr)
+        return;
+
+      int64_t startEpoch = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count();
+      fwrite(MAGIC, 1, sizeof(MAGIC), file);
+      fwrite(&startEpoch, sizeof(startEpoch), 1, file);
+      flusher = std::thread(&Writer::flushLoop, this);
+    }
+
+    ~Writer()
+    {
+      if (file == nullptr)
+        return;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      wakeup.notify_one();
+      flusher.join();
+      fclose(file);
+    }
+
+    bool isOpen() const
+    {
+      return file != nullptr;
+    }
+
+    uint64_t getDropped() const
+    {
+      return dropped;
+    }
+
+    void record(Method method, const std::string &route, const std::string &body)
+    {
+      uint16_t routeSize = static_cast<uint16_t>(std::min<size_t>(route.size(), UINT16_MAX));
+      uint32_t bodySize = static_cast<uint32_t>(std::min<size_t>(body.size(), UINT32_MAX));
+
+      char header[RECORD_HEADER_SIZE];
+      header[8] = static_cast<char>(method);
+      memcpy(header + 9, &routeSize, 2);
+      memcpy(header + 11, &bodySize, 4);
+
+      bool flushNow;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (pending.size() + sizeof(header) + routeSize + bodySize > maxBuffered)
+        {
+          dropped++;
+          return;
+        }
+        // Taken under the lock so records are written in timestamp order
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        memcpy(header, &timestamp, 8);
+        pending.append(header, sizeof(header));
+        pending.append(route, 0, routeSize);
+        pending.append(body, 0, bodySize);
+        flushNow = pending.size() > maxBuffered / 2;
+      }
+      if (flushNow)
+        wakeup.notify_one();
+    }
+
+  private:
+    void flushLoop()
+    {
+      std::string writing;
+      std::unique_lock<std::mutex> guard(lock);
+      while (true)
+      {
+        wakeup.wait_for(guard, std::chrono::milliseconds(100));
+        writing.swap(pending);
+        bool done = stopping;
+        guard.unlock();
+
+        if (!writing.empty())
+        {
+          fwrite(writing.data(), 1, writing.size(), file);
+          fflush(file);
+          writing.clear();
+        }
+        if (done)
+          return;
+        guard.lock();
+      }
+    }
+
+    FILE *file = nullptr;
+    size_t maxBuffered;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<uint64_t> dropped{0};
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::string pending;
+    bool stopping = false;
+    std::thread flusher;
+  };
+
+  class Reader
+  {
+  public:
+    explicit Reader(const std::string &path)
+    {
+      file = fopen(path.c_str(), "rb");
+      char magic[sizeof(MAGIC)];
+      if (file == nullptr || fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+          memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || fread(&startEpoch, sizeof(startEpoch), 1, file) != 1)
+      {
+        if (file != nullptr)
+          fclose(file);
+        file = nullptr;
+      }
+    }
+
+    ~Reader()
+    {
+      if (file != nullptr)
+        fclose(file);
+    }
+
+    bool isOpen() const
+    {
+      return file != nullptr;
+    }
+
+    // Microseconds since the epoch at which the capture started
+    int64_t getStartEpoch() const
+    {
+      return startEpoch;
+    }
+
+    // Returns false at the end of the file or on a truncated record
+    bool next(Request &request)
+    {
+      char header[RECORD_HEADER_SIZE];
+      if (file == nullptr || fread(header, 1, sizeof(header), file) != sizeof(header))
+        return false;
+
+      uint16_t routeSize;
+      uint32_t bodySize;
+      memcpy(&request.timestamp, header, 8);
+      request.method = static_cast<Method>(header[8]);
+      memcpy(&routeSize, header + 9, 2);
+      memcpy(&bodySize, header + 11, 4);
+
+      request.route.resize(routeSize);
+      request.body.resize(bodySize);
+      return fread(&request.route[0], 1, routeSize, file) == routeSize &&
+             fread(&request.body[0], 1, bodySize, file) == bodySize;
+    }
+
+  private:
+    FILE *file = nullptr;
+    int64_t startEpoch = 0;
+  };
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <nlohmann/json.hpp>
+
+#include "HttpConnection.h"
+
+// Delivers events to HTTP webhooks from a background thread.
+//
+// notify() only stores the event under its key and returns, so request threads never wait on the network.
+// Events are collected for a short batching window and sent as one POST per webhook:
+//   {"machine": "<source>", "events": [ ... ]}
+// Events with the same key are coalesced (the newest wins), also while a webhook is being retried.
+// A failed delivery is retried with exponential backoff; after maxAttempts the batch is dropped.
+class WebhookDispatcher
+{
+public:
+  struct Options
+  {
+    std::chrono::milliseconds batchWindow{200};
+    std::chrono::milliseconds initialBackoff{500};
+    std::chrono::milliseconds maxBackoff{30000};
+    int maxAttempts = 8;
+    int timeoutMs = 2000;
+  };
+
+  WebhookDispatcher(const std::vector<std::string> &urls, const std::string &source)
+      : WebhookDispatcher(urls, source, Options()) {}
+
+  WebhookDispatcher(const std::vector<std::string> &urls, const std::string &source, Options options)
+      : source(source), options(options)
+  {
+    for (const std::string &url : urls)
+    {
+      Target target;
+      if (!HttpConnection::parseUrl(url, target.host, target.port, target.path))
+      {
+        std::cerr << "Ignoring webhook " << url << ", only http://host[:port]/path is supported" << std::endl;
+        continue;
+      }
+      target.url = url;
+      targets.push_back(target);
+    }
+    if (!targets.empty())
+      worker = std::thread(&WebhookDispatcher::run, this);
+  }
+
+  // Stops the worker after one last delivery attempt of whatever is pending
+  ~WebhookDispatcher()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wakeup.notify_one();
+    if (worker.joinable())
+      worker.join();
+  }
+
+  bool hasTargets() const
+  {
+    return !targets.empty();
+  }
+
+  void notify(const std::string &key, nlohmann::json event)
+  {
+    if (targets.empty())
+      return;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      pending[key] = std::move(event);
+    }
+    wakeup.notify_one();
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Target
+  {
+    std::string url;
+    std::string host;
+    std::string port;
+    std::string path;
+    std::map<std::string, nlohmann::json> outbox; // coalesced events not delivered yet
+    int attempts = 0;
+    Clock::time_point nextAttempt;
+  };
+
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+      // Sleep until there are events or a retry is due
+      Clock::time_point wakeAt = Clock::time_point::max();
+      for (const Target &target : targets)
+        if (!target.outbox.empty())
+          wakeAt = std::min(wakeAt, target.nextAttempt);
+      if (pending.empty() && !stopping)
+      {
+        if (wakeAt == Clock::time_point::max())
+          wakeup.wait(guard);
+        else
+          wakeup.wait_until(guard, wakeAt);
+      }
+
+      // Let a burst of setter calls land in the same batch
+      if (!pending.empty() && !stopping)
+        wakeup.wait_for(guard, options.batchWindow, [this]()
+                        { return stopping; });
+
+      std::map<std::string, nlohmann::json> events;
+      events.swap(pending);
+      bool done = stopping;
+      guard.unlock();
+
+      for (Target &target : targets)
+      {
+        for (auto &event : events)
+          target.outbox[event.first] = event.second;
+        if (!target.outbox.empty() && (done || Clock::now() >= target.nextAttempt))
+          deliver(target);
+      }
+
+      if (done)
+        return;
+      guard.lock();
+    }
+  }
+
+  void deliver(Target &target)
+  {
+    nlohmann::json body;
+    body["machine"] = source;
+    body["events"] = nlohmann::json::array();
+    for (auto &event : target.outbox)
+      body["events"].push_back(event.second);
+
+    HttpConnection connection(target.host, target.port, options.timeoutMs);
+    std::string response;
+    int status = connection.send("POST", target.path, body.dump(), "", response);
+    if (status >= 200 && status < 300)
+    {
+      target.outbox.clear();
+      target.attempts = 0;
+      return;
+    }
+
+    target.attempts++;
+    if (target.attempts >= options.maxAttempts)
+    {
+      std::cerr << "Webhook " << target.url << " failed " << target.attempts << " times, dropping "
+                << target.outbox.size() << " events" << std::endl;
+      target.outbox.clear();
+      target.attempts = 0;
+      return;
+    }
+    auto backoff = std::min(options.maxBackoff, options.initialBackoff * (1 << std::min(target.attempts - 1, 16)));
+    target.nextAttempt = Clock::now() + backoff;
+  }
+
+  std::string source;
+  Options options;
+  std::vector<Target> targets; // only touched by the worker once it runs
+
+  std::mutex lock;
+  std::condition_variable wakeup;
+  std::map<std::string, nlohmann::json> pending;
+  bool stopping = false;
+  std::thread worker;
+};
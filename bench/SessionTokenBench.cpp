@@ -0,0 +1,82 @@
+// Compares /coffee request processing (parse + validate) without authentication against the same
+// pipeline with a session token check, both when the token is in the verified cache and when every
+// request carries a token that has to be HMAC-verified.
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../OrderValidator.h"
+#include "../SessionTokens.h"
+
+using namespace std;
+using namespace nlohmann;
+
+static const string body = R"({"type":"ESPRESSO","cupSize":"CUP_M","foamSize":"FOAM_S","coffeeStrength":60})";
+
+static const vector<OrderValidator::Rule> rules = {
+    OrderValidator::oneOf("type", {"CAPPUCCINO", "ESPRESSO", "LATTE_MACHIATTO", "CAFFE_LATTE", "DOPPIO", "AMERICANO"}, "Invalid coffee type!"),
+    OrderValidator::oneOf("cupSize", {"CUP_S", "CUP_M", "CUP_L", "CUP_XL"}, "Invalid cup size!"),
+    OrderValidator::oneOf("foamSize", {"FOAM_S", "FOAM_M", "FOAM_L"}, "Invalid foam size!"),
+    OrderValidator::intRange("coffeeStrength", 45, 100, "Invalid coffee strength!")};
+
+static bool handleOrder()
+{
+  json req;
+  return OrderValidator::parse(body, req) && OrderValidator::validate(req, rules) == 0;
+}
+
+// Runs work(thread, i) for requests iterations split over the threads, returns requests per second
+template <typename F>
+static double throughput(int threads, int requests, F work)
+{
+  atomic<int> failures(0);
+  vector<thread> workers;
+  auto begin = chrono::steady_clock::now();
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([&, t]()
+                         {
+      for (int i = t; i < requests; i += threads)
+        if (!work(t, i))
+          failures++; });
+  for (thread &worker : workers)
+    worker.join();
+  auto end = chrono::steady_clock::now();
+  if (failures > 0)
+    cerr << failures << " requests failed" << endl;
+  return requests / chrono::duration<double>(end - begin).count();
+}
+
+int main(int argc, char *argv[])
+{
+  int requests = argc >= 2 ? stoi(argv[1]) : 200000;
+  int maxThreads = argc >= 3 ? stoi(argv[2]) : static_cast<int>(thread::hardware_concurrency());
+
+  cout << "threads   no auth req/s   cached token req/s   HMAC verify req/s" << endl;
+  for (int threads = 1; threads <= maxThreads; threads *= 2)
+  {
+    SessionTokens tokens;
+
+    // One long lived token per worker, as sent by a kiosk on every order
+    vector<string> kioskTokens;
+    for (int t = 0; t < threads; t++)
+      kioskTokens.push_back(tokens.issue());
+
+    // A fresh token per request so every check misses the cache
+    SessionTokens coldTokens;
+    vector<string> freshTokens;
+    for (int i = 0; i < requests; i++)
+      freshTokens.push_back(coldTokens.issue());
+
+    double baseline = throughput(threads, requests, [&](int, int)
+                                 { return handleOrder(); });
+    double cached = throughput(threads, requests, [&](int t, int)
+                               { return tokens.verify(kioskTokens[t]) && handleOrder(); });
+    double verified = throughput(threads, requests, [&](int, int i)
+                                 { return coldTokens.verify(freshTokens[i]) && handleOrder(); });
+    printf("%7d %15.0f %20.0f %19.0f\n", threads, baseline, cached, verified);
+  }
+}
@@ -0,0 +1,160 @@
+// Throughput of the /coffee path without the HTTP layer, per worker thread count (the thread count passed to init).
+// Every simulated order is parsed, validated, brewed on the shared CoffeeMachine under one mutex and counted:
+//   "before":  the counters were bumped inside the lock, after copying the coffee type list to find the type index
+//   "shared":  counters bumped after the lock is released, one set of atomics every thread updates
+//   "sharded": counters bumped after the lock is released, ShardedCounters with one slot per thread (the server)
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../CoffeeMachine.h"
+#include "../OrderValidator.h"
+#include "../ShardedCounters.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static const size_t COUNTERS = 16;
+static const size_t ORDERS_SERVED = 0, ORDERS_INVALID = 1, ORDERS_BY_TYPE = 8;
+
+static const vector<string> bodies = {
+    R"({"type": "CAPPUCCINO", "cupSize": "CUP_M", "foamSize": "FOAM_S", "coffeeStrength": 60})",
+    R"({"type": "ESPRESSO", "cupSize": "CUP_S", "foamSize": "FOAM_S", "coffeeStrength": 90})",
+    R"({"type": "AMERICANO", "cupSize": "CUP_L", "foamSize": "FOAM_M", "coffeeStrength": 50})",
+    R"({"type": "CAFFE_LATTE", "cupSize": "CUP_XL", "foamSize": "FOAM_L", "coffeeStrength": 45})"};
+
+enum Mode
+{
+  BEFORE,
+  SHARED,
+  SHARDED
+};
+
+struct Server
+{
+  mutex lock;
+  CoffeeMachine machine;
+  shared_ptr<const vector<string>> coffeeTypes;
+  vector<OrderValidator::Rule> rules;
+  atomic<long> shared[COUNTERS] = {};
+  ShardedCounters<COUNTERS> sharded;
+
+  explicit Server(int threads) : sharded(threads)
+  {
+    coffeeTypes = make_shared<const vector<string>>(machine.getCoffeeTypeValues());
+    rules = {
+        OrderValidator::oneOfCurrent("type", coffeeTypes, "Invalid coffee type!"),
+        OrderValidator::oneOf("cupSize", machine.getCupSizeValues(), "Invalid cup size!"),
+        OrderValidator::oneOf("foamSize", machine.getFoamSizeValues(), "Invalid foam size!"),
+        OrderValidator::intRange("coffeeStrength", 45, 100, "Invalid coffee strength!")};
+  }
+
+  // Same model updates as CoffeeMachineController::brew, refilling and cleaning instantly so every order is served
+  size_t brew(const json &req)
+  {
+    string type = req["type"];
+    const json *recipe = machine.findRecipe(type);
+    if (machine.getMilkLevel() < 20 || machine.getWaterLevel() < 20 || machine.getBeansLevel() < 20)
+    {
+      machine.setMilkLevel(100);
+      machine.setWaterLevel(100);
+      machine.setBeansLevel(100);
+    }
+    if (machine.getCleanLevel() <= 0)
+      machine.setCleanLevel(100);
+    machine.setCoffeeType(type);
+    machine.setCupSize(req["cupSize"]);
+    machine.setFoamSize(req["foamSize"]);
+    machine.setCoffeeStrength(req["coffeeStrength"]);
+    machine.setMilkLevel(machine.getMilkLevel() - (*recipe)[CoffeeMachine::RECIPE_MILK].get<int>());
+    machine.setWaterLevel(machine.getWaterLevel() - (*recipe)[CoffeeMachine::RECIPE_WATER].get<int>());
+    machine.setBeansLevel(machine.getBeansLevel() - (*recipe)[CoffeeMachine::RECIPE_BEANS].get<int>());
+    machine.setCleanLevel(machine.getCleanLevel() - CoffeeMachine::CLEAN_LEVEL_PER_CUP);
+    json res;
+    res["type"] = machine.getCoffeeType();
+    res["status"] = "Coffee done :)";
+    return res.dump(4).size();
+  }
+
+  void add(Mode mode, size_t counter)
+  {
+    if (mode == SHARED)
+      shared[counter].fetch_add(1, memory_order_relaxed);
+    else
+      sharded.add(counter);
+  }
+
+  size_t order(Mode mode, const string &body)
+  {
+    json req;
+    if (!OrderValidator::parse(body, req) || OrderValidator::validate(req, rules) != 0)
+    {
+      add(mode, ORDERS_INVALID);
+      return 0;
+    }
+
+    size_t sent, typeIndex;
+    {
+      lock_guard<mutex> guard(lock);
+      sent = brew(req);
+      if (mode == BEFORE)
+      {
+        vector<string> coffeeTypes = machine.getCoffeeTypeValues();
+        typeIndex = find(coffeeTypes.begin(), coffeeTypes.end(), req["type"].get<string>()) - coffeeTypes.begin();
+        add(mode, ORDERS_SERVED);
+        add(mode, ORDERS_BY_TYPE + typeIndex);
+        return sent;
+      }
+      typeIndex = machine.getCoffeeTypeIndex(req["type"]);
+    }
+    add(mode, ORDERS_SERVED);
+    add(mode, ORDERS_BY_TYPE + typeIndex);
+    return sent;
+  }
+
+  long served(Mode mode)
+  {
+    return mode == SHARED ? shared[ORDERS_SERVED].load() : sharded.get(ORDERS_SERVED);
+  }
+};
+
+static double ordersPerSecond(Mode mode, int threads, long ordersPerThread, bool &ok)
+{
+  Server server(threads);
+  vector<thread> workers;
+  atomic<size_t> sent{0};
+  auto begin = chrono::steady_clock::now();
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([&, t]()
+                         {
+      size_t bytes = 0;
+      for (long i = 0; i < ordersPerThread; i++)
+        bytes += server.order(mode, bodies[(t + i) % bodies.size()]);
+      sent += bytes; });
+  for (thread &worker : workers)
+    worker.join();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+  ok = ok && sent > 0 && server.served(mode) == threads * ordersPerThread;
+  return threads * ordersPerThread / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+  long ordersPerThread = argc >= 2 ? stol(argv[1]) : 200000;
+  int maxThreads = argc >= 3 ? stoi(argv[2]) : 64;
+
+  cout << "cores: " << thread::hardware_concurrency() << endl;
+  cout << "threads   before orders/s   shared orders/s   sharded orders/s   counts ok" << endl;
+  for (int threads = 1; threads <= maxThreads; threads *= 2)
+  {
+    bool ok = true;
+    double before = ordersPerSecond(BEFORE, threads, ordersPerThread, ok);
+    double shared = ordersPerSecond(SHARED, threads, ordersPerThread, ok);
+    double sharded = ordersPerSecond(SHARDED, threads, ordersPerThread, ok);
+    printf("%7d %17.0f %17.0f %18.0f   %s\n", threads, before, shared, sharded, ok ? "yes" : "NO");
+  }
+}
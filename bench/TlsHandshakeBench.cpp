@@ -0,0 +1,114 @@
+// Measures TLS handshake rates against a running server (e.g. ./CoffeeMachineController with a certificate):
+// "full" does a complete handshake on every connection, "resumed" offers the session from the previous
+// connection so the server can resume it from its session ticket or session cache.
+// Each connection sends one GET /getCleanLevel and reads the answer, like a kiosk polling the machine.
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+using namespace std;
+
+static int connectTo(const string &host, const string &port)
+{
+  addrinfo hints = {}, *result = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+    return -1;
+
+  int fd = -1;
+  for (addrinfo *it = result; it != nullptr; it = it->ai_next)
+  {
+    fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (fd >= 0 && connect(fd, it->ai_addr, it->ai_addrlen) == 0)
+      break;
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+// One connection: handshake, request, response. Returns false on failure.
+// session is offered for resumption when set and replaced by the new one afterwards.
+static bool request(SSL_CTX *ctx, const string &host, const string &port, SSL_SESSION **session, bool &resumed)
+{
+  int fd = connectTo(host, port);
+  if (fd < 0)
+    return false;
+
+  SSL *ssl = SSL_new(ctx);
+  SSL_set_fd(ssl, fd);
+  SSL_set_tlsext_host_name(ssl, host.c_str());
+  if (session != nullptr && *session != nullptr)
+    SSL_set_session(ssl, *session);
+
+  bool ok = SSL_connect(ssl) == 1;
+  if (ok)
+  {
+    string get = "GET /getCleanLevel HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    ok = SSL_write(ssl, get.data(), static_cast<int>(get.size())) > 0;
+    // Reading also processes the TLS 1.3 session tickets sent after the handshake
+    char buffer[4096];
+    while (ok && SSL_read(ssl, buffer, sizeof(buffer)) > 0)
+    {
+    }
+    resumed = SSL_session_reused(ssl) == 1;
+    if (session != nullptr)
+    {
+      if (*session != nullptr)
+        SSL_SESSION_free(*session);
+      *session = SSL_get1_session(ssl);
+    }
+    SSL_shutdown(ssl);
+  }
+  SSL_free(ssl);
+  close(fd);
+  return ok;
+}
+
+static void run(SSL_CTX *ctx, const string &host, const string &port, int connections, bool resume)
+{
+  SSL_SESSION *session = nullptr;
+  int failed = 0, resumedCount = 0;
+
+  auto begin = chrono::steady_clock::now();
+  for (int i = 0; i < connections; i++)
+  {
+    bool resumed = false;
+    if (!request(ctx, host, port, resume ? &session : nullptr, resumed))
+      failed++;
+    else if (resumed)
+      resumedCount++;
+  }
+  auto end = chrono::steady_clock::now();
+
+  if (session != nullptr)
+    SSL_SESSION_free(session);
+  double seconds = chrono::duration<double>(end - begin).count();
+  printf("%-8s %8d conns %10.0f conn/s %8.1f%% resumed %6d failed\n", resume ? "resumed" : "full",
+         connections, connections / seconds, 100.0 * resumedCount / connections, failed);
+}
+
+int main(int argc, char *argv[])
+{
+  string host = argc >= 2 ? argv[1] : "127.0.0.1";
+  string port = argc >= 3 ? argv[2] : "9080";
+  int connections = argc >= 4 ? stoi(argv[3]) : 1000;
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  // Self-signed bench certificates are not verified
+  SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+
+  run(ctx, host, port, connections, false);
+  run(ctx, host, port, connections, true);
+
+  SSL_CTX_free(ctx);
+}
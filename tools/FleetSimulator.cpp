@@ -0,0 +1,457 @@
+// Discrete-event simulation of a fleet of coffee machines, used to size the fleet and plan refill rounds.
+//
+// Every virtual machine is a CoffeeMachine with the recipe table of the real one. Orders arrive as a
+// Poisson stream; each one needs the recipe's milk, water and beans and makes the machine
+// CLEAN_LEVEL_PER_CUP dirtier, exactly like POST /coffee. Cleaning follows the server's CleaningCycle:
+// a machine too dirty to brew starts a timed cycle, orders arriving meanwhile wait for it (up to
+// MAX_QUEUED_ORDERS) and an idle dirty machine cleans itself. Refill rounds fill all resources to 100
+// and cleaning rounds start a cycle like POST /cleanCoffeeMachine.
+//
+//   ./tools/FleetSimulator [--machines 1000] [--days 7] [--orders-per-hour 4]
+//                          [--refill-every 24] [--clean-every 8] [--cycle-minutes 1]
+//                          [--capture traffic.cap [--arrivals poisson|capture]] [--threads N] [--seed 1]
+//
+// With --capture the coffee type mix (and, unless --orders-per-hour is given, the order rate) is taken
+// from a traffic capture instead of being uniform. With --arrivals capture every machine instead replays
+// the recorded /coffee orders themselves, with their bursts and daily peaks: the recording is tiled over
+// the simulated days, starting at a random offset per machine.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../CleaningCycle.h"
+#include "../CoffeeMachine.h"
+#include "../OrderValidator.h"
+#include "../TrafficCapture.h"
+
+using namespace std;
+using namespace nlohmann;
+
+// Resources used by one cup, flattened from CoffeeMachine::getCoffeeRecipes
+struct Recipe
+{
+  string type;
+  int milk;
+  int water;
+  int beans;
+  double cumulativeWeight; // for picking the type of an order
+};
+
+struct Settings
+{
+  long machines = 1000;
+  double days = 7;
+  double ordersPerHour = 4;
+  double refillEveryHours = 24;
+  double cleanEveryHours = 8;
+  double cycleHours = chrono::duration<double, ratio<3600>>(CleaningCycle::Durations().rinse + CleaningCycle::Durations().descale +
+                                                            CleaningCycle::Durations().dry)
+                          .count();
+  string capture;
+  bool replayCapture = false; // --arrivals capture
+  int threads = static_cast<int>(thread::hardware_concurrency());
+  uint64_t seed = 1;
+};
+
+// The /coffee orders of a capture: hours since the first one and index into the recipes, sorted by time.
+// period is the span plus one average gap, so tiling the recording keeps its order rate.
+struct RecordedStream
+{
+  vector<pair<double, size_t>> orders;
+  double period = 0;
+};
+
+// Each thread has its own Stats, written on every order; alignas keeps neighbouring threads off each other's cache lines
+struct alignas(64) Stats
+{
+  uint64_t orders = 0;
+  uint64_t served = 0;
+  uint64_t rejected = 0;
+  uint64_t noMilk = 0;
+  uint64_t noWater = 0;
+  uint64_t noBeans = 0;
+  uint64_t stockOuts = 0; // rejected for missing milk, water or beans (an order can miss several)
+  uint64_t queueFull = 0; // rejected because too many orders waited for a cleaning cycle
+  uint64_t queued = 0;    // waited for a cleaning cycle, then made or rejected on stock
+  uint64_t cycles = 0;
+  double queuedHours = 0; // total wait of the queued orders
+  uint64_t machinesWithStockOut = 0;
+  vector<double> machineServiceLevels;
+
+  void add(const Stats &other)
+  {
+    orders += other.orders;
+    served += other.served;
+    rejected += other.rejected;
+    noMilk += other.noMilk;
+    noWater += other.noWater;
+    noBeans += other.noBeans;
+    stockOuts += other.stockOuts;
+    queueFull += other.queueFull;
+    queued += other.queued;
+    cycles += other.cycles;
+    queuedHours += other.queuedHours;
+    machinesWithStockOut += other.machinesWithStockOut;
+    machineServiceLevels.insert(machineServiceLevels.end(), other.machineServiceLevels.begin(), other.machineServiceLevels.end());
+  }
+};
+
+// splitmix64: small, fast and seeded per machine so results don't depend on the thread count
+class Random
+{
+public:
+  explicit Random(uint64_t seed) : state(seed) {}
+
+  uint64_t next()
+  {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in (0, 1]
+  double uniform()
+  {
+    return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+  }
+
+  double exponential(double rate)
+  {
+    return -log(uniform()) / rate;
+  }
+
+private:
+  uint64_t state;
+};
+
+static void simulateMachine(long id, const Settings &settings, const vector<Recipe> &recipes, const RecordedStream &recorded, Stats &stats)
+{
+  CoffeeMachine machine;
+  Random random(settings.seed * 0x100000001b3ULL + id);
+
+  const double horizon = settings.days * 24;
+  const double ratePerHour = settings.ordersPerHour;
+  const double autoCleanIdle = chrono::duration<double, ratio<3600>>(CleaningCycle::AUTO_CLEAN_IDLE).count();
+  double nextRefill = settings.refillEveryHours > 0 ? settings.refillEveryHours : horizon;
+  double nextClean = settings.cleanEveryHours > 0 ? settings.cleanEveryHours : horizon;
+  double cycleEnd = -1; // end of the running cleaning cycle, negative while not cleaning
+  double lastOrder = 0;
+  vector<pair<double, const Recipe *>> queue; // orders waiting for the cycle, with their arrival time
+  uint64_t orders = 0, served = 0, stockOuts = 0;
+
+  auto startCycle = [&](double at)
+  {
+    cycleEnd = at + settings.cycleHours;
+    stats.cycles++;
+  };
+  auto brew = [&](const Recipe &recipe)
+  {
+    bool noMilk = machine.getMilkLevel() < recipe.milk;
+    bool noWater = machine.getWaterLevel() < recipe.water;
+    bool noBeans = machine.getBeansLevel() < recipe.beans;
+    if (noMilk || noWater || noBeans)
+    {
+      stockOuts++;
+      stats.noMilk += noMilk;
+      stats.noWater += noWater;
+      stats.noBeans += noBeans;
+      return;
+    }
+    machine.setMilkLevel(machine.getMilkLevel() - recipe.milk);
+    machine.setWaterLevel(machine.getWaterLevel() - recipe.water);
+    machine.setBeansLevel(machine.getBeansLevel() - recipe.beans);
+    machine.setCleanLevel(machine.getCleanLevel() - CoffeeMachine::CLEAN_LEVEL_PER_CUP);
+    served++;
+  };
+  // Same as CoffeeMachineController::finishCleaning: waiting orders are made in arrival order,
+  // and if they make the machine too dirty again the rest waits for another cycle
+  auto finishCycle = [&]()
+  {
+    double end = cycleEnd;
+    cycleEnd = -1;
+    machine.setCleanLevel(100);
+    size_t made = 0;
+    for (; made < queue.size(); made++)
+    {
+      if (machine.getCleanLevel() <= 0)
+      {
+        startCycle(end);
+        break;
+      }
+      stats.queued++;
+      stats.queuedHours += end - queue[made].first;
+      brew(*queue[made].second);
+    }
+    queue.erase(queue.begin(), queue.begin() + made);
+  };
+
+  // Moves t to the next order and returns its recipe: a Poisson stream with the configured type mix,
+  // or the recorded stream tiled from a random offset into the recording
+  size_t recordedIndex = 0;
+  double tileStart = settings.replayCapture ? -random.uniform() * recorded.period : 0;
+  auto nextOrder = [&](double &t) -> const Recipe &
+  {
+    if (!settings.replayCapture)
+    {
+      t += random.exponential(ratePerHour);
+      double pick = random.uniform() * recipes.back().cumulativeWeight;
+      return *lower_bound(recipes.begin(), recipes.end(), pick, [](const Recipe &r, double value)
+                          { return r.cumulativeWeight < value; });
+    }
+    do
+    {
+      if (recordedIndex == recorded.orders.size())
+      {
+        recordedIndex = 0;
+        tileStart += recorded.period;
+      }
+      t = tileStart + recorded.orders[recordedIndex++].first;
+    } while (t < 0);
+    return recipes[recorded.orders[recordedIndex - 1].second];
+  };
+
+  double t = 0;
+  for (const Recipe *recipe = &nextOrder(t); t < horizon; recipe = &nextOrder(t))
+  {
+    // Rounds, cycle ends and automatic cleaning due before this order happen first, in time order
+    while (true)
+    {
+      double next = min(nextRefill, nextClean);
+      bool autoClean = cycleEnd < 0 && machine.getCleanLevel() < CleaningCycle::AUTO_CLEAN_LEVEL;
+      if (cycleEnd >= 0)
+        next = min(next, cycleEnd);
+      else if (autoClean)
+        next = min(next, lastOrder + autoCleanIdle);
+      if (next > t)
+        break;
+
+      if (cycleEnd >= 0 && next == cycleEnd)
+        finishCycle();
+      else if (next == nextRefill)
+      {
+        machine.setMilkLevel(100);
+        machine.setWaterLevel(100);
+        machine.setBeansLevel(100);
+        nextRefill += settings.refillEveryHours;
+      }
+      else if (next == nextClean)
+      {
+        if (cycleEnd < 0 && machine.getCleanLevel() < CoffeeMachine::CLEAN_THRESHOLD)
+          startCycle(nextClean);
+        nextClean += settings.cleanEveryHours;
+      }
+      else
+        startCycle(next);
+    }
+
+    orders++;
+    lastOrder = t;
+
+    if (cycleEnd < 0 && machine.getCleanLevel() <= 0)
+      startCycle(t);
+    if (cycleEnd < 0)
+      brew(*recipe);
+    else if (queue.size() >= CleaningCycle::MAX_QUEUED_ORDERS)
+      stats.queueFull++;
+    else
+      queue.emplace_back(t, recipe);
+  }
+  // Orders still waiting at the end of the horizon are made when their cycle ends
+  while (cycleEnd >= 0)
+    finishCycle();
+
+  stats.orders += orders;
+  stats.served += served;
+  stats.rejected += orders - served;
+  stats.stockOuts += stockOuts;
+  stats.machinesWithStockOut += stockOuts > 0;
+  stats.machineServiceLevels.push_back(orders > 0 ? double(served) / orders : 1.0);
+}
+
+static vector<Recipe> loadRecipes()
+{
+  vector<Recipe> recipes;
+  json table = CoffeeMachine().getCoffeeRecipes();
+  for (auto &entry : table.items())
+  {
+    recipes.push_back({entry.key(), entry.value()[CoffeeMachine::RECIPE_MILK].get<int>(),
+                       entry.value()[CoffeeMachine::RECIPE_WATER].get<int>(),
+                       entry.value()[CoffeeMachine::RECIPE_BEANS].get<int>(), 1});
+  }
+  return recipes;
+}
+
+// Weights the recipes by the /coffee orders of a capture and keeps the orders in recorded.
+// Returns the captured orders per hour, 0 if unknown.
+static double loadCapture(const string &path, vector<Recipe> &recipes, RecordedStream &recorded)
+{
+  TrafficCapture::Reader reader(path);
+  if (!reader.isOpen())
+  {
+    cerr << "Cannot read capture file " << path << endl;
+    exit(1);
+  }
+
+  map<string, double> counts;
+  vector<pair<uint64_t, string>> captured;
+  uint64_t first = UINT64_MAX, last = 0, orders = 0;
+  TrafficCapture::Request request;
+  while (reader.next(request))
+  {
+    json body;
+    if (request.route != "/coffee" || !OrderValidator::parse(request.body, body) || !body["type"].is_string())
+      continue;
+    counts[body["type"].get<string>()]++;
+    captured.emplace_back(request.timestamp, body["type"].get<string>());
+    // Older captures may be slightly out of order, so take the extremes rather than the first and last record
+    orders++;
+    first = min(first, request.timestamp);
+    last = max(last, request.timestamp);
+  }
+
+  for (Recipe &recipe : recipes)
+    recipe.cumulativeWeight = counts[recipe.type];
+  recipes.erase(remove_if(recipes.begin(), recipes.end(), [](const Recipe &r)
+                          { return r.cumulativeWeight == 0; }),
+                recipes.end());
+  if (recipes.empty())
+  {
+    cerr << "No orders with a known recipe in " << path << endl;
+    exit(1);
+  }
+
+  double hours = orders > 1 ? (last - first) / 3.6e9 : 0;
+
+  // Replayed in time order
+  stable_sort(captured.begin(), captured.end(), [](const pair<uint64_t, string> &a, const pair<uint64_t, string> &b)
+              { return a.first < b.first; });
+  for (auto &order : captured)
+  {
+    auto recipe = find_if(recipes.begin(), recipes.end(), [&](const Recipe &r)
+                          { return r.type == order.second; });
+    if (recipe != recipes.end())
+      recorded.orders.emplace_back((order.first - first) / 3.6e9, recipe - recipes.begin());
+  }
+  recorded.period = orders > 1 ? hours * orders / (orders - 1) : 0;
+
+  return orders > 1 && hours > 0 ? (orders - 1) / hours : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  Settings settings;
+  bool rateGiven = false;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    string name = argv[i], value = argv[i + 1];
+    if (name == "--machines")
+      settings.machines = stol(value);
+    else if (name == "--days")
+      settings.days = stod(value);
+    else if (name == "--orders-per-hour")
+    {
+      settings.ordersPerHour = stod(value);
+      rateGiven = true;
+    }
+    else if (name == "--refill-every")
+      settings.refillEveryHours = stod(value);
+    else if (name == "--clean-every")
+      settings.cleanEveryHours = stod(value);
+    else if (name == "--cycle-minutes")
+      settings.cycleHours = stod(value) / 60;
+    else if (name == "--capture")
+      settings.capture = value;
+    else if (name == "--arrivals" && (value == "poisson" || value == "capture"))
+      settings.replayCapture = value == "capture";
+    else if (name == "--threads")
+      settings.threads = stoi(value);
+    else if (name == "--seed")
+      settings.seed = stoull(value);
+    else
+    {
+      cerr << "Unknown option " << name << endl;
+      return 1;
+    }
+  }
+  settings.threads = max(1, settings.threads);
+  if (settings.machines < 1 || settings.days <= 0 || settings.refillEveryHours < 0 || settings.cleanEveryHours < 0 || settings.cycleHours < 0)
+  {
+    cerr << "--machines and --days must be positive, --refill-every, --clean-every and --cycle-minutes not negative" << endl;
+    return 1;
+  }
+
+  vector<Recipe> recipes = loadRecipes();
+  RecordedStream recorded;
+  if (!settings.capture.empty())
+  {
+    double capturedRate = loadCapture(settings.capture, recipes, recorded);
+    if (!rateGiven && capturedRate > 0)
+      settings.ordersPerHour = capturedRate;
+  }
+  if (settings.replayCapture && !(recorded.period > 0))
+  {
+    cerr << "--arrivals capture needs --capture with at least two /coffee orders recorded at different times" << endl;
+    return 1;
+  }
+  // The order loop steps by exponential(ordersPerHour), which never advances for a rate <= 0
+  if (!settings.replayCapture && !(settings.ordersPerHour > 0))
+  {
+    cerr << "--orders-per-hour must be positive" << endl;
+    return 1;
+  }
+  double cumulative = 0;
+  for (Recipe &recipe : recipes)
+    recipe.cumulativeWeight = cumulative += recipe.cumulativeWeight;
+
+  // Machines are independent, so each thread simulates an interleaved slice of the fleet
+  vector<Stats> threadStats(settings.threads);
+  vector<thread> workers;
+  auto begin = chrono::steady_clock::now();
+  for (int t = 0; t < settings.threads; t++)
+    workers.emplace_back([&, t]()
+                         {
+      for (long id = t; id < settings.machines; id += settings.threads)
+        simulateMachine(id, settings, recipes, recorded, threadStats[t]); });
+  for (thread &worker : workers)
+    worker.join();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+  Stats total;
+  for (Stats &stats : threadStats)
+    total.add(stats);
+  sort(total.machineServiceLevels.begin(), total.machineServiceLevels.end());
+  auto percent = [&](uint64_t count)
+  { return total.orders > 0 ? 100.0 * count / total.orders : 0.0; };
+  auto machinePercentile = [&](double p)
+  { return 100.0 * total.machineServiceLevels[min(total.machineServiceLevels.size() - 1, size_t(p * total.machineServiceLevels.size()))]; };
+
+  if (settings.replayCapture)
+    printf("%ld machines, %.1f days, recorded orders (%zu over %.2f h, tiled), refill every %.1f h, clean every %.1f h, %.1f min cleaning cycles\n",
+           settings.machines, settings.days, recorded.orders.size(), recorded.period, settings.refillEveryHours, settings.cleanEveryHours, settings.cycleHours * 60);
+  else
+    printf("%ld machines, %.1f days, %.2f orders/hour per machine, refill every %.1f h, clean every %.1f h, %.1f min cleaning cycles\n",
+           settings.machines, settings.days, settings.ordersPerHour, settings.refillEveryHours, settings.cleanEveryHours, settings.cycleHours * 60);
+  printf("orders             %llu\n", (unsigned long long)total.orders);
+  printf("service level      %.2f%%\n", percent(total.served));
+  printf("rejected           %.2f%%\n", percent(total.rejected));
+  printf("stock-out rate     %.2f%%\n", percent(total.stockOuts));
+  printf("  no milk          %.2f%%\n", percent(total.noMilk));
+  printf("  no water         %.2f%%\n", percent(total.noWater));
+  printf("  no beans         %.2f%%\n", percent(total.noBeans));
+  printf("cleaning queue full  %.2f%%\n", percent(total.queueFull));
+  printf("waited for cleaning  %.2f%%, %.1f s on average\n", percent(total.queued),
+         total.queued > 0 ? total.queuedHours * 3600 / total.queued : 0.0);
+  printf("cleaning cycles    %llu\n", (unsigned long long)total.cycles);
+  printf("machines with a stock-out  %.2f%%\n", 100.0 * total.machinesWithStockOut / max(1L, settings.machines));
+  if (!total.machineServiceLevels.empty())
+    printf("machine service level  p5 %.2f%%  p50 %.2f%%  worst %.2f%%\n",
+           machinePercentile(0.05), machinePercentile(0.5), machinePercentile(0));
+  printf("simulated %.0f orders/s on %d threads\n", total.orders / seconds, settings.threads);
+}
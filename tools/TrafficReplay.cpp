@@ -0,0 +1,147 @@
+// Replays a capture recorded with COFFEE_MACHINE_CAPTURE against a running CoffeeMachineController
+// and reports the response latency.
+//
+//   ./tools/TrafficReplay <capture file> [host] [port] [speed] [connections]
+//
+// speed is a multiplier of the recorded pace (1 = as recorded, 10 = ten times faster) or "max"
+// to send every request as soon as a connection is free.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../HttpConnection.h"
+#include "../TrafficCapture.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct Result
+{
+  double latencyMs; // from the scheduled send time to the end of the response
+  int status;
+};
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    cerr << "usage: " << argv[0] << " <capture file> [host] [port] [speed|max] [connections]" << endl;
+    return 1;
+  }
+  string host = argc >= 3 ? argv[2] : "127.0.0.1";
+  string port = argc >= 4 ? argv[3] : "9080";
+  string speedArg = argc >= 5 ? argv[4] : "1";
+  double speed = speedArg == "max" ? 0 : stod(speedArg);
+  int connections = argc >= 6 ? stoi(argv[5]) : 8;
+
+  TrafficCapture::Reader reader(argv[1]);
+  if (!reader.isOpen())
+  {
+    cerr << "Cannot read capture file " << argv[1] << endl;
+    return 1;
+  }
+  vector<TrafficCapture::Request> requests;
+  TrafficCapture::Request request;
+  while (reader.next(request))
+    requests.push_back(request);
+  if (requests.empty())
+  {
+    cerr << "Capture file is empty" << endl;
+    return 1;
+  }
+  // Older captures may have concurrent requests slightly out of order; the schedule below needs them sorted
+  stable_sort(requests.begin(), requests.end(), [](const TrafficCapture::Request &a, const TrafficCapture::Request &b)
+              { return a.timestamp < b.timestamp; });
+
+  // Captures don't contain session tokens, so get a fresh one for the POST endpoints
+  string cookie;
+  {
+    HttpConnection auth(host, port);
+    string body;
+    if (auth.send("GET", "/auth", "", "", body) != 200)
+      cerr << "GET /auth failed, POST requests will be rejected" << endl;
+    cookie = auth.getSetCookie();
+  }
+
+  // The dispatcher queues each request at its (scaled) time, workers send them over their own connection
+  mutex lock;
+  condition_variable ready;
+  deque<pair<size_t, Clock::time_point>> queue;
+  bool finished = false;
+  vector<Result> results(requests.size());
+
+  vector<thread> workers;
+  for (int c = 0; c < connections; c++)
+    workers.emplace_back([&]()
+                         {
+      HttpConnection connection(host, port);
+      string body;
+      while (true)
+      {
+        unique_lock<mutex> guard(lock);
+        ready.wait(guard, [&]() { return finished || !queue.empty(); });
+        if (queue.empty())
+          return;
+        auto job = queue.front();
+        queue.pop_front();
+        guard.unlock();
+
+        // At recorded speed latency counts from the scheduled time, so falling behind shows up in it.
+        // At max speed everything is queued at once; counting from the dequeue measures the server, not this queue.
+        Clock::time_point sent = speed > 0 ? job.second : Clock::now();
+        const TrafficCapture::Request &r = requests[job.first];
+        string method = r.method == TrafficCapture::POST ? "POST" : "GET";
+        int status = connection.send(method, r.route, r.body, cookie, body);
+        results[job.first] = {chrono::duration<double, milli>(Clock::now() - sent).count(), status};
+      } });
+
+  Clock::time_point begin = Clock::now();
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    Clock::time_point due = begin;
+    if (speed > 0)
+    {
+      due += chrono::microseconds(static_cast<int64_t>((requests[i].timestamp - requests[0].timestamp) / speed));
+      this_thread::sleep_until(due);
+    }
+    {
+      lock_guard<mutex> guard(lock);
+      queue.emplace_back(i, due);
+    }
+    ready.notify_one();
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    finished = true;
+  }
+  ready.notify_all();
+  for (thread &worker : workers)
+    worker.join();
+  double seconds = chrono::duration<double>(Clock::now() - begin).count();
+
+  vector<double> latencies;
+  map<int, int> statuses;
+  for (const Result &result : results)
+  {
+    latencies.push_back(result.latencyMs);
+    statuses[result.status]++;
+  }
+  sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p)
+  { return latencies[min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))]; };
+
+  double recorded = (requests.back().timestamp - requests.front().timestamp) / 1e6;
+  printf("%zu requests recorded over %.1f s, replayed in %.1f s (%.0f req/s) with %d connections\n",
+         requests.size(), recorded, seconds, requests.size() / seconds, connections);
+  printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+         percentile(0.50), percentile(0.90), percentile(0.99), latencies.back());
+  for (auto &status : statuses)
+    printf("status %d: %d\n", status.first, status.second);
+}
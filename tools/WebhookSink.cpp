@@ -0,0 +1,88 @@
+// Local HTTP sink for trying out the webhook notifications (COFFEE_MACHINE_WEBHOOKS).
+// Prints the body of every request it receives and answers 200, or 503 for a share of them
+// to exercise the retries.
+//
+//   ./tools/WebhookSink [port] [failure rate 0..1]
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+using namespace std;
+
+static void serve(int client, double failureRate)
+{
+  // One generator per connection thread, they run detached and concurrently
+  thread_local mt19937 random(random_device{}());
+  string buffer;
+  char chunk[16384];
+  while (true)
+  {
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos)
+    {
+      ssize_t n = recv(client, chunk, sizeof(chunk), 0);
+      if (n <= 0)
+      {
+        close(client);
+        return;
+      }
+      buffer.append(chunk, n);
+    }
+
+    size_t contentLength = 0;
+    size_t lengthHeader = buffer.find("Content-Length:");
+    if (lengthHeader != string::npos && lengthHeader < headerEnd)
+      contentLength = stoul(buffer.substr(lengthHeader + 15));
+    while (buffer.size() < headerEnd + 4 + contentLength)
+    {
+      ssize_t n = recv(client, chunk, sizeof(chunk), 0);
+      if (n <= 0)
+      {
+        close(client);
+        return;
+      }
+      buffer.append(chunk, n);
+    }
+
+    string requestLine = buffer.substr(0, buffer.find("\r\n"));
+    string body = buffer.substr(headerEnd + 4, contentLength);
+    buffer.erase(0, headerEnd + 4 + contentLength);
+
+    bool fail = uniform_real_distribution<double>(0, 1)(random) < failureRate;
+    cout << (fail ? "[503] " : "[200] ") << requestLine << " " << body << endl;
+    string response = fail ? "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n"
+                           : "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    send(client, response.data(), response.size(), MSG_NOSIGNAL);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int port = argc >= 2 ? stoi(argv[1]) : 9090;
+  double failureRate = argc >= 3 ? stod(argv[2]) : 0;
+
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(server, 16) != 0)
+  {
+    perror("cannot listen");
+    return 1;
+  }
+  cout << "Webhook sink listening on http://127.0.0.1:" << port << "/" << endl;
+
+  while (true)
+  {
+    int client = accept(server, nullptr, nullptr);
+    if (client >= 0)
+      thread(serve, client, failureRate).detach();
+  }
+}